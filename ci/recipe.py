@@ -92,6 +92,9 @@ Stage0 += environment(variables={
 })
 #Stage0 += copy(src='labs/', dest='/labs/')
 Stage0 += copy(src='include/cartesian_product.hpp', dest='/usr/include/cartesian_product.hpp')
+Stage0 += copy(src='include/numa.hpp', dest='/usr/include/numa.hpp')
+Stage0 += copy(src='include/bench.hpp', dest='/usr/include/bench.hpp')
+Stage0 += copy(src='include/trace.hpp', dest='/usr/include/trace.hpp')
 Stage0 += copy(src='include/ranges', dest=f'/usr/include/c++/{gcc_ver}/ranges')
 
 Stage0 += environment(variables={
@@ -0,0 +1,823 @@
+#pragma once
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Benchmark harness shared by the labs.
+//!
+//! `benchmark::run` times a kernel with warm-up runs and repetitions, and `benchmark::result::add` collects
+//! the timings of loops that cannot be re-run, e.g., the time steps of a solver. A `benchmark::model`
+//! gives the bytes moved and the floating-point operations of one repetition, from which the
+//! bandwidth and throughput of the median repetition are reported with `benchmark::report`.
+//!
+//! Binaries keep their command line arguments, and the harness is configured with environment
+//! variables:
+//!
+//! - `BENCH_WARMUP`, `BENCH_REPS`: number of warm-up runs and of timed repetitions, overriding the
+//!   defaults of each call of `benchmark::run`.
+//! - `BENCH_FORMAT`: `text` (default), `json` (one JSON object per line), or `csv`.
+//! - `BENCH_OUTPUT`: file that reports are appended to, instead of `stderr`. CSV reports start a
+//!   new or empty file with a header, such that the runs appended to one file share it.
+//! - `BENCH_COUNTERS=1`: also counts the memory traffic and floating-point operations of
+//!   `benchmark::run` with the hardware counters of the CPU, or of the GPU in builds with
+//!   `-DUSE_CUPTI`, see `counters`.
+//! - `BENCH_PEAK_GBS`, `BENCH_PEAK_GFLOPS`: peak bandwidth and throughput of the machine, e.g., from
+//!   STREAM and the data sheet, which add the share of the peak bandwidth and the position of the
+//!   kernel on the roofline to the reports. These use the DRAM bytes counted on the GPU, but never
+//!   the last-level cache read misses counted on the CPU, which omit the write-backs.
+//!
+//! JSON and CSV reports contain the compiler and the device that the binary was built for, such that
+//! reports of different builds can be compared.
+//! Values that are not finite, e.g., the bandwidth of a result without repetitions, are `null` in
+//! JSON and empty in CSV.
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#if defined(__linux__) && !defined(_NVHPC_STDPAR_GPU)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_NVHPC_STDPAR_GPU) && defined(USE_CUPTI)
+#include <cuda.h>
+#include <cuda_runtime_api.h>
+#include <cupti_profiler_target.h>
+#include <cupti_target.h>
+#include <nvperf_cuda_host.h>
+#include <nvperf_host.h>
+#include <nvperf_target.h>
+#endif
+
+namespace benchmark {
+
+using clock = std::chrono::steady_clock;
+
+/// Seconds elapsed since `start`
+inline double seconds_since(clock::time_point start) {
+  return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+/// Work performed by one repetition of a kernel
+struct model {
+  double bytes = 0.; // Bytes read and written from/to memory
+  double flops = 0.; // Floating-point operations
+};
+
+/// Number of warm-up runs and of timed repetitions
+struct options {
+  int warmup = 1;
+  int reps = 10;
+};
+
+/// Returns `defaults`, overridden by the `BENCH_WARMUP` and `BENCH_REPS` environment variables
+inline options from_env(options defaults) {
+  if (auto e = std::getenv("BENCH_WARMUP")) defaults.warmup = std::stoi(e);
+  if (auto e = std::getenv("BENCH_REPS")) defaults.reps = std::stoi(e);
+  if (defaults.warmup < 0 || defaults.reps < 1) {
+    std::cerr << "ERROR: BENCH_WARMUP=" << defaults.warmup << " must be >= 0 and BENCH_REPS="
+              << defaults.reps << " must be >= 1" << std::endl;
+    std::abort();
+  }
+  return defaults;
+}
+
+/// Timings of the repetitions of a kernel
+struct result {
+  std::string name = {};
+  model work = {};
+  int warmup = 0;
+  std::vector<double> seconds = {};
+  bool counted = false; // Whether `measured` holds hardware counts
+  model measured = {};  // Hardware counts per repetition, see `counters::bytes_kind`
+
+  /// Adds the timing of one repetition
+  void add(double s) { seconds.push_back(s); }
+
+  /// Returns the `q`-quantile of the timings, with `q` in [0, 1], using the nearest-rank method
+  double quantile(double q) const {
+    if (seconds.empty()) return 0.;
+    auto sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = (std::size_t)std::ceil(q * (double)sorted.size());
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+  }
+  double min() const { return quantile(0.); }
+  double median() const { return quantile(0.5); }
+  double p95() const { return quantile(0.95); }
+
+  /// Bandwidth in [GB/s] and throughput in [GFLOP/s] of the median repetition
+  double gbs() const { return work.bytes * 1e-9 / median(); }
+  double gflops() const { return work.flops * 1e-9 / median(); }
+};
+
+/// Hardware counters, enabled with `BENCH_COUNTERS=1`
+///
+/// On the CPU, the perf events of the threads of this process are counted around the timed
+/// repetitions of `benchmark::run`:
+/// - Bytes are 64 B per last-level cache miss, i.e., the bytes that the last-level cache reads from
+///   memory for loads. They omit the write-backs of dirty lines, and on some CPUs the hardware
+///   prefetches, so they are reported as "LLC read-miss bytes", not as bandwidth. For DRAM counts,
+///   profile with the uncore events of the memory controllers, e.g.,
+///   `perf stat -e uncore_imc/cas_count_read/,uncore_imc/cas_count_write/`, instead.
+/// - FLOPs are counted with the raw PMU events of `BENCH_FLOPS_EVENTS`, a comma-separated list of
+///   `config:flops` pairs, since CPUs have no architectural FLOP event. For example, on Intel CPUs
+///   the FP_ARITH_INST_RETIRED events of double precision scalar, 128-, 256- and 512-bit
+///   instructions are `0x01c7:1,0x04c7:2,0x10c7:4,0x40c7:8` (FMAs count as 2 instructions).
+/// - Only the threads that exist when the counters are opened, i.e., after the warm-up runs of
+///   `benchmark::run` started the threads of the parallel algorithms, and their children, are
+///   counted, in user space only, which `perf_event_paranoid` <= 2 allows.
+///
+/// On the GPU, the CUPTI range profiler counts the DRAM bytes read and written, and the double
+/// precision FLOPs (FMAs count as 2), of all kernels that one run of the kernel launches. It
+/// serializes kernels and replays the run once per pass, so it counts extra runs after the timed
+/// repetitions. The build needs `-DUSE_CUPTI` and the CUPTI headers and libraries of the CUDA
+/// toolkit, e.g., `-cuda -I${CUDA_HOME}/extras/CUPTI/include -L${CUDA_HOME}/extras/CUPTI/lib64
+/// -lcupti -lnvperf_host -lnvperf_target -lcuda`; other GPU builds do not count.
+struct counters {
+  /// Returns whether `BENCH_COUNTERS=1`
+  static bool enabled() {
+    auto e = std::getenv("BENCH_COUNTERS");
+    return e != nullptr && std::string_view(e) == "1";
+  }
+
+#if defined(__linux__) && !defined(_NVHPC_STDPAR_GPU)
+  /// What the counted bytes are: last-level cache read misses, which are not the DRAM traffic
+  static constexpr std::string_view bytes_kind = "llc_read_miss";
+
+  struct counter {
+    int fd;
+    double bytes, flops; // Per event
+  };
+  std::vector<counter> events;
+
+  /// Opens the counters of all threads of this process; leaves `events` empty if that fails
+  counters() {
+    struct event {
+      std::uint32_t type;
+      std::uint64_t config;
+      double bytes, flops;
+    };
+    std::vector<event> es{{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 64., 0.}};
+    if (auto e = std::getenv("BENCH_FLOPS_EVENTS")) {
+      std::istringstream list(e);
+      for (std::string item; std::getline(list, item, ',');) {
+        auto colon = item.find(':');
+        if (colon == std::string::npos) {
+          std::cerr << "ERROR: BENCH_FLOPS_EVENTS item \"" << item << "\" is not config:flops" << std::endl;
+          std::abort();
+        }
+        es.push_back({PERF_TYPE_RAW, std::stoull(item.substr(0, colon), nullptr, 0), 0.,
+                      std::stod(item.substr(colon + 1))});
+      }
+    }
+    for (auto const &task : std::filesystem::directory_iterator("/proc/self/task")) {
+      auto tid = std::stoi(task.path().filename().string());
+      for (auto const &e : es) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = e.type;
+        attr.config = e.config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+        if (fd < 0) {
+          // Threads may exit while iterating; any other failure disables the counters:
+          if (errno == ESRCH) continue;
+          static bool warned = false;
+          if (!warned) {
+            std::cerr << "WARNING: BENCH_COUNTERS=1 but perf_event_open of event " << std::hex
+                      << e.config << std::dec << " failed: " << std::strerror(errno) << std::endl;
+            warned = true;
+          }
+          close();
+          return;
+        }
+        events.push_back({fd, e.bytes, e.flops});
+      }
+    }
+  }
+  ~counters() { close(); }
+  counters(counters const &) = delete;
+  counters &operator=(counters const &) = delete;
+
+  /// Returns whether the counters are open
+  bool ready() const { return !events.empty(); }
+  void close() {
+    for (auto &e : events) ::close(e.fd);
+    events.clear();
+  }
+  void start() {
+    for (auto &e : events) {
+      ioctl(e.fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  /// Stops the counters, and returns the bytes and FLOPs counted since `start`
+  model stop() {
+    model m;
+    for (auto &e : events) {
+      ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+      std::uint64_t count = 0;
+      if (::read(e.fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+      m.bytes += e.bytes * (double)count;
+      m.flops += e.flops * (double)count;
+    }
+    return m;
+  }
+#elif defined(_NVHPC_STDPAR_GPU) && defined(USE_CUPTI)
+  /// What the counted bytes are: DRAM reads and writes
+  static constexpr std::string_view bytes_kind = "dram";
+
+  struct metric {
+    char const *name;
+    double bytes, flops; // Per unit of the metric
+  };
+  static constexpr metric metrics[] = {
+    {"dram__bytes_read.sum", 1., 0.},
+    {"dram__bytes_write.sum", 1., 0.},
+    {"sm__sass_thread_inst_executed_op_dadd_pred_on.sum", 0., 1.},
+    {"sm__sass_thread_inst_executed_op_dmul_pred_on.sum", 0., 1.},
+    {"sm__sass_thread_inst_executed_op_dfma_pred_on.sum", 0., 2.},
+  };
+
+  CUcontext ctx = nullptr;
+  bool initialized = false, configured = false;
+  std::vector<std::uint8_t> availability, evaluator_scratch, config, prefix;
+  NVPW_MetricsEvaluator *evaluator = nullptr;
+  std::vector<NVPW_MetricEvalRequest> requests;
+
+  /// Warns once, and returns false, if `call` failed
+  static bool check(bool success, char const *call) {
+    static bool warned = false;
+    if (!success && !warned) {
+      std::cerr << "WARNING: BENCH_COUNTERS=1 but " << call << " failed" << std::endl;
+      warned = true;
+    }
+    return success;
+  }
+  static bool check(CUptiResult r, char const *call) { return check(r == CUPTI_SUCCESS, call); }
+  static bool check(NVPA_Status s, char const *call) { return check(s == NVPA_STATUS_SUCCESS, call); }
+
+  /// Creates the configuration of the profiler for `metrics` in the primary context of the device,
+  /// which the parallel algorithms use; `ready()` is false if that fails
+  counters() {
+    int device = 0;
+    cudaFree(nullptr); // Makes the primary context current
+    if (!check(cudaGetDevice(&device) == cudaSuccess, "cudaGetDevice")
+        || !check(cuCtxGetCurrent(&ctx) == CUDA_SUCCESS, "cuCtxGetCurrent")) {
+      return;
+    }
+    NVPW_InitializeHost_Params host{};
+    host.structSize = NVPW_InitializeHost_Params_STRUCT_SIZE;
+    CUpti_Profiler_Initialize_Params init{};
+    init.structSize = CUpti_Profiler_Initialize_Params_STRUCT_SIZE;
+    if (!check(NVPW_InitializeHost(&host), "NVPW_InitializeHost")
+        || !check(cuptiProfilerInitialize(&init), "cuptiProfilerInitialize")) {
+      return;
+    }
+    initialized = true;
+
+    // The chip and the counters that are available in this context:
+    CUpti_Device_GetChipName_Params chip{};
+    chip.structSize = CUpti_Device_GetChipName_Params_STRUCT_SIZE;
+    chip.deviceIndex = (std::size_t)device;
+    CUpti_Profiler_GetCounterAvailability_Params avail{};
+    avail.structSize = CUpti_Profiler_GetCounterAvailability_Params_STRUCT_SIZE;
+    avail.ctx = ctx;
+    if (!check(cuptiDeviceGetChipName(&chip), "cuptiDeviceGetChipName")
+        || !check(cuptiProfilerGetCounterAvailability(&avail), "cuptiProfilerGetCounterAvailability")) {
+      return;
+    }
+    availability.resize(avail.counterAvailabilityImageSize);
+    avail.pCounterAvailabilityImage = availability.data();
+    if (!check(cuptiProfilerGetCounterAvailability(&avail), "cuptiProfilerGetCounterAvailability")) return;
+
+    // The evaluator of the metrics, and the raw counters that they depend on:
+    NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params size{};
+    size.structSize = NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params_STRUCT_SIZE;
+    size.pChipName = chip.pChipName;
+    size.pCounterAvailabilityImage = availability.data();
+    if (!check(NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize(&size), "NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize")) {
+      return;
+    }
+    evaluator_scratch.resize(size.scratchBufferSize);
+    NVPW_CUDA_MetricsEvaluator_Initialize_Params eval{};
+    eval.structSize = NVPW_CUDA_MetricsEvaluator_Initialize_Params_STRUCT_SIZE;
+    eval.pScratchBuffer = evaluator_scratch.data();
+    eval.scratchBufferSize = evaluator_scratch.size();
+    eval.pChipName = chip.pChipName;
+    eval.pCounterAvailabilityImage = availability.data();
+    if (!check(NVPW_CUDA_MetricsEvaluator_Initialize(&eval), "NVPW_CUDA_MetricsEvaluator_Initialize")) return;
+    evaluator = eval.pMetricsEvaluator;
+    for (auto const &m : metrics) {
+      NVPW_MetricEvalRequest request{};
+      NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params convert{};
+      convert.structSize = NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params_STRUCT_SIZE;
+      convert.pMetricsEvaluator = evaluator;
+      convert.pMetricName = m.name;
+      convert.pMetricEvalRequest = &request;
+      convert.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
+      if (!check(NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest(&convert), m.name)) return;
+      requests.push_back(request);
+    }
+    NVPW_MetricsEvaluator_GetMetricRawDependencies_Params deps{};
+    deps.structSize = NVPW_MetricsEvaluator_GetMetricRawDependencies_Params_STRUCT_SIZE;
+    deps.pMetricsEvaluator = evaluator;
+    deps.pMetricEvalRequests = requests.data();
+    deps.numMetricEvalRequests = requests.size();
+    deps.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
+    deps.metricEvalRequestStrideSize = sizeof(NVPW_MetricEvalRequest);
+    if (!check(NVPW_MetricsEvaluator_GetMetricRawDependencies(&deps), "NVPW_MetricsEvaluator_GetMetricRawDependencies")) {
+      return;
+    }
+    std::vector<char const *> raw_names(deps.numRawDependencies);
+    deps.ppRawDependencies = raw_names.data();
+    if (!check(NVPW_MetricsEvaluator_GetMetricRawDependencies(&deps), "NVPW_MetricsEvaluator_GetMetricRawDependencies")) {
+      return;
+    }
+    std::vector<NVPA_RawMetricRequest> raw;
+    for (auto name : raw_names) raw.push_back({NVPA_RAW_METRIC_REQUEST_STRUCT_SIZE, nullptr, name, true, true});
+
+    // The configuration of the passes that count the raw counters:
+    NVPW_CUDA_RawMetricsConfig_Create_V2_Params create{};
+    create.structSize = NVPW_CUDA_RawMetricsConfig_Create_V2_Params_STRUCT_SIZE;
+    create.activityKind = NVPA_ACTIVITY_KIND_PROFILER;
+    create.pChipName = chip.pChipName;
+    create.pCounterAvailabilityImage = availability.data();
+    if (!check(NVPW_CUDA_RawMetricsConfig_Create_V2(&create), "NVPW_CUDA_RawMetricsConfig_Create_V2")) return;
+    NVPW_RawMetricsConfig_BeginPassGroup_Params begin{};
+    begin.structSize = NVPW_RawMetricsConfig_BeginPassGroup_Params_STRUCT_SIZE;
+    begin.pRawMetricsConfig = create.pRawMetricsConfig;
+    NVPW_RawMetricsConfig_AddMetrics_Params add{};
+    add.structSize = NVPW_RawMetricsConfig_AddMetrics_Params_STRUCT_SIZE;
+    add.pRawMetricsConfig = create.pRawMetricsConfig;
+    add.pRawMetricRequests = raw.data();
+    add.numMetricRequests = raw.size();
+    NVPW_RawMetricsConfig_EndPassGroup_Params end{};
+    end.structSize = NVPW_RawMetricsConfig_EndPassGroup_Params_STRUCT_SIZE;
+    end.pRawMetricsConfig = create.pRawMetricsConfig;
+    NVPW_RawMetricsConfig_GenerateConfigImage_Params generate{};
+    generate.structSize = NVPW_RawMetricsConfig_GenerateConfigImage_Params_STRUCT_SIZE;
+    generate.pRawMetricsConfig = create.pRawMetricsConfig;
+    NVPW_RawMetricsConfig_GetConfigImage_Params image{};
+    image.structSize = NVPW_RawMetricsConfig_GetConfigImage_Params_STRUCT_SIZE;
+    image.pRawMetricsConfig = create.pRawMetricsConfig;
+    bool created = check(NVPW_RawMetricsConfig_BeginPassGroup(&begin), "NVPW_RawMetricsConfig_BeginPassGroup")
+                   && check(NVPW_RawMetricsConfig_AddMetrics(&add), "NVPW_RawMetricsConfig_AddMetrics")
+                   && check(NVPW_RawMetricsConfig_EndPassGroup(&end), "NVPW_RawMetricsConfig_EndPassGroup")
+                   && check(NVPW_RawMetricsConfig_GenerateConfigImage(&generate), "NVPW_RawMetricsConfig_GenerateConfigImage")
+                   && check(NVPW_RawMetricsConfig_GetConfigImage(&image), "NVPW_RawMetricsConfig_GetConfigImage");
+    if (created) {
+      config.resize(image.bytesCopied);
+      image.bytesAllocated = config.size();
+      image.pBuffer = config.data();
+      created = check(NVPW_RawMetricsConfig_GetConfigImage(&image), "NVPW_RawMetricsConfig_GetConfigImage");
+    }
+    NVPW_RawMetricsConfig_Destroy_Params destroy{};
+    destroy.structSize = NVPW_RawMetricsConfig_Destroy_Params_STRUCT_SIZE;
+    destroy.pRawMetricsConfig = create.pRawMetricsConfig;
+    NVPW_RawMetricsConfig_Destroy(&destroy);
+    if (!created) return;
+
+    // The prefix of the counter data images, which hold the counts of the raw counters:
+    NVPW_CUDA_CounterDataBuilder_Create_Params builder{};
+    builder.structSize = NVPW_CUDA_CounterDataBuilder_Create_Params_STRUCT_SIZE;
+    builder.pChipName = chip.pChipName;
+    builder.pCounterAvailabilityImage = availability.data();
+    if (!check(NVPW_CUDA_CounterDataBuilder_Create(&builder), "NVPW_CUDA_CounterDataBuilder_Create")) return;
+    NVPW_CounterDataBuilder_AddMetrics_Params add_raw{};
+    add_raw.structSize = NVPW_CounterDataBuilder_AddMetrics_Params_STRUCT_SIZE;
+    add_raw.pCounterDataBuilder = builder.pCounterDataBuilder;
+    add_raw.pRawMetricRequests = raw.data();
+    add_raw.numMetricRequests = raw.size();
+    NVPW_CounterDataBuilder_GetCounterDataPrefix_Params get{};
+    get.structSize = NVPW_CounterDataBuilder_GetCounterDataPrefix_Params_STRUCT_SIZE;
+    get.pCounterDataBuilder = builder.pCounterDataBuilder;
+    bool built = check(NVPW_CounterDataBuilder_AddMetrics(&add_raw), "NVPW_CounterDataBuilder_AddMetrics")
+                 && check(NVPW_CounterDataBuilder_GetCounterDataPrefix(&get), "NVPW_CounterDataBuilder_GetCounterDataPrefix");
+    if (built) {
+      prefix.resize(get.bytesCopied);
+      get.bytesAllocated = prefix.size();
+      get.pBuffer = prefix.data();
+      built = check(NVPW_CounterDataBuilder_GetCounterDataPrefix(&get), "NVPW_CounterDataBuilder_GetCounterDataPrefix");
+    }
+    NVPW_CounterDataBuilder_Destroy_Params destroy_builder{};
+    destroy_builder.structSize = NVPW_CounterDataBuilder_Destroy_Params_STRUCT_SIZE;
+    destroy_builder.pCounterDataBuilder = builder.pCounterDataBuilder;
+    NVPW_CounterDataBuilder_Destroy(&destroy_builder);
+    configured = built;
+  }
+  ~counters() {
+    if (evaluator != nullptr) {
+      NVPW_MetricsEvaluator_Destroy_Params destroy{};
+      destroy.structSize = NVPW_MetricsEvaluator_Destroy_Params_STRUCT_SIZE;
+      destroy.pMetricsEvaluator = evaluator;
+      NVPW_MetricsEvaluator_Destroy(&destroy);
+    }
+    if (initialized) {
+      CUpti_Profiler_DeInitialize_Params deinit{};
+      deinit.structSize = CUpti_Profiler_DeInitialize_Params_STRUCT_SIZE;
+      cuptiProfilerDeInitialize(&deinit);
+    }
+  }
+  counters(counters const &) = delete;
+  counters &operator=(counters const &) = delete;
+
+  /// Returns whether the profiler is configured
+  bool ready() const { return configured; }
+
+  /// Runs `f` once per pass of the profiler as a single user range, and returns the bytes and
+  /// FLOPs of one run
+  template <class F>
+  model count(F &&f) {
+    model m;
+    // A counter data image with a single range:
+    CUpti_Profiler_CounterDataImageOptions options{};
+    options.structSize = CUpti_Profiler_CounterDataImageOptions_STRUCT_SIZE;
+    options.pCounterDataPrefix = prefix.data();
+    options.counterDataPrefixSize = prefix.size();
+    options.maxNumRanges = 1;
+    options.maxNumRangeTreeNodes = 1;
+    options.maxRangeNameLength = 64;
+    CUpti_Profiler_CounterDataImage_CalculateSize_Params size{};
+    size.structSize = CUpti_Profiler_CounterDataImage_CalculateSize_Params_STRUCT_SIZE;
+    size.sizeofCounterDataImageOptions = CUpti_Profiler_CounterDataImageOptions_STRUCT_SIZE;
+    size.pOptions = &options;
+    if (!check(cuptiProfilerCounterDataImageCalculateSize(&size), "cuptiProfilerCounterDataImageCalculateSize")) return m;
+    std::vector<std::uint8_t> image(size.counterDataImageSize);
+    CUpti_Profiler_CounterDataImage_Initialize_Params init{};
+    init.structSize = CUpti_Profiler_CounterDataImage_Initialize_Params_STRUCT_SIZE;
+    init.sizeofCounterDataImageOptions = CUpti_Profiler_CounterDataImageOptions_STRUCT_SIZE;
+    init.pOptions = &options;
+    init.counterDataImageSize = image.size();
+    init.pCounterDataImage = image.data();
+    CUpti_Profiler_CounterDataImage_CalculateScratchBufferSize_Params scratch_size{};
+    scratch_size.structSize = CUpti_Profiler_CounterDataImage_CalculateScratchBufferSize_Params_STRUCT_SIZE;
+    scratch_size.counterDataImageSize = image.size();
+    scratch_size.pCounterDataImage = image.data();
+    if (!check(cuptiProfilerCounterDataImageInitialize(&init), "cuptiProfilerCounterDataImageInitialize")
+        || !check(cuptiProfilerCounterDataImageCalculateScratchBufferSize(&scratch_size),
+                  "cuptiProfilerCounterDataImageCalculateScratchBufferSize")) {
+      return m;
+    }
+    std::vector<std::uint8_t> scratch(scratch_size.counterDataScratchBufferSize);
+    CUpti_Profiler_CounterDataImage_InitializeScratchBuffer_Params init_scratch{};
+    init_scratch.structSize = CUpti_Profiler_CounterDataImage_InitializeScratchBuffer_Params_STRUCT_SIZE;
+    init_scratch.counterDataImageSize = image.size();
+    init_scratch.pCounterDataImage = image.data();
+    init_scratch.counterDataScratchBufferSize = scratch.size();
+    init_scratch.pCounterDataScratchBuffer = scratch.data();
+    if (!check(cuptiProfilerCounterDataImageInitializeScratchBuffer(&init_scratch),
+               "cuptiProfilerCounterDataImageInitializeScratchBuffer")) {
+      return m;
+    }
+
+    // A session that replays `f` until all passes of the configuration have been submitted:
+    CUpti_Profiler_BeginSession_Params session{};
+    session.structSize = CUpti_Profiler_BeginSession_Params_STRUCT_SIZE;
+    session.ctx = ctx;
+    session.counterDataImageSize = image.size();
+    session.pCounterDataImage = image.data();
+    session.counterDataScratchBufferSize = scratch.size();
+    session.pCounterDataScratchBuffer = scratch.data();
+    session.range = CUPTI_UserRange;
+    session.replayMode = CUPTI_UserReplay;
+    session.maxRangesPerPass = 1;
+    session.maxLaunchesPerPass = 1;
+    if (!check(cuptiProfilerBeginSession(&session), "cuptiProfilerBeginSession")) return m;
+    CUpti_Profiler_SetConfig_Params set{};
+    set.structSize = CUpti_Profiler_SetConfig_Params_STRUCT_SIZE;
+    set.ctx = ctx;
+    set.pConfig = config.data();
+    set.configSize = config.size();
+    set.passIndex = 0;
+    set.minNestingLevel = 1;
+    set.numNestingLevels = 1;
+    bool counted = check(cuptiProfilerSetConfig(&set), "cuptiProfilerSetConfig");
+    for (bool done = !counted; !done;) {
+      CUpti_Profiler_BeginPass_Params begin{};
+      begin.structSize = CUpti_Profiler_BeginPass_Params_STRUCT_SIZE;
+      CUpti_Profiler_EnableProfiling_Params enable{};
+      enable.structSize = CUpti_Profiler_EnableProfiling_Params_STRUCT_SIZE;
+      CUpti_Profiler_PushRange_Params push{};
+      push.structSize = CUpti_Profiler_PushRange_Params_STRUCT_SIZE;
+      CUpti_Profiler_PopRange_Params pop{};
+      pop.structSize = CUpti_Profiler_PopRange_Params_STRUCT_SIZE;
+      CUpti_Profiler_DisableProfiling_Params disable{};
+      disable.structSize = CUpti_Profiler_DisableProfiling_Params_STRUCT_SIZE;
+      CUpti_Profiler_EndPass_Params end{};
+      end.structSize = CUpti_Profiler_EndPass_Params_STRUCT_SIZE;
+      begin.ctx = enable.ctx = push.ctx = pop.ctx = disable.ctx = end.ctx = ctx;
+      push.pRangeName = "benchmark";
+      counted = check(cuptiProfilerBeginPass(&begin), "cuptiProfilerBeginPass")
+                && check(cuptiProfilerEnableProfiling(&enable), "cuptiProfilerEnableProfiling")
+                && check(cuptiProfilerPushRange(&push), "cuptiProfilerPushRange");
+      if (counted) f(); // The parallel algorithms synchronize with the device before returning
+      counted = counted && check(cuptiProfilerPopRange(&pop), "cuptiProfilerPopRange")
+                && check(cuptiProfilerDisableProfiling(&disable), "cuptiProfilerDisableProfiling")
+                && check(cuptiProfilerEndPass(&end), "cuptiProfilerEndPass");
+      done = !counted || end.allPassesSubmitted;
+    }
+    CUpti_Profiler_FlushCounterData_Params flush{};
+    flush.structSize = CUpti_Profiler_FlushCounterData_Params_STRUCT_SIZE;
+    flush.ctx = ctx;
+    counted = counted && check(cuptiProfilerFlushCounterData(&flush), "cuptiProfilerFlushCounterData");
+    CUpti_Profiler_UnsetConfig_Params unset{};
+    unset.structSize = CUpti_Profiler_UnsetConfig_Params_STRUCT_SIZE;
+    unset.ctx = ctx;
+    cuptiProfilerUnsetConfig(&unset);
+    CUpti_Profiler_EndSession_Params end_session{};
+    end_session.structSize = CUpti_Profiler_EndSession_Params_STRUCT_SIZE;
+    end_session.ctx = ctx;
+    cuptiProfilerEndSession(&end_session);
+    if (!counted) return m;
+
+    // The metrics of the range:
+    NVPW_MetricsEvaluator_SetDeviceAttributes_Params attributes{};
+    attributes.structSize = NVPW_MetricsEvaluator_SetDeviceAttributes_Params_STRUCT_SIZE;
+    attributes.pMetricsEvaluator = evaluator;
+    attributes.pCounterDataImage = image.data();
+    attributes.counterDataImageSize = image.size();
+    std::vector<double> values(requests.size());
+    NVPW_MetricsEvaluator_EvaluateToGpuValues_Params evaluate{};
+    evaluate.structSize = NVPW_MetricsEvaluator_EvaluateToGpuValues_Params_STRUCT_SIZE;
+    evaluate.pMetricsEvaluator = evaluator;
+    evaluate.pMetricEvalRequests = requests.data();
+    evaluate.numMetricEvalRequests = requests.size();
+    evaluate.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
+    evaluate.metricEvalRequestStrideSize = sizeof(NVPW_MetricEvalRequest);
+    evaluate.pCounterDataImage = image.data();
+    evaluate.counterDataImageSize = image.size();
+    evaluate.rangeIndex = 0;
+    evaluate.isolated = true;
+    evaluate.pMetricValues = values.data();
+    if (!check(NVPW_MetricsEvaluator_SetDeviceAttributes(&attributes), "NVPW_MetricsEvaluator_SetDeviceAttributes")
+        || !check(NVPW_MetricsEvaluator_EvaluateToGpuValues(&evaluate), "NVPW_MetricsEvaluator_EvaluateToGpuValues")) {
+      return m;
+    }
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      m.bytes += metrics[i].bytes * values[i];
+      m.flops += metrics[i].flops * values[i];
+    }
+    return m;
+  }
+#else
+  static constexpr std::string_view bytes_kind = "";
+
+  counters() {
+    static bool warned = false;
+    if (warned) return;
+#if defined(_NVHPC_STDPAR_GPU)
+    std::cerr << "WARNING: BENCH_COUNTERS=1 counts GPU kernels in builds with -DUSE_CUPTI only, otherwise profile "
+              << "them with Nsight Compute (ncu)" << std::endl;
+#else
+    std::cerr << "WARNING: BENCH_COUNTERS=1 requires the perf events of Linux" << std::endl;
+#endif
+    warned = true;
+  }
+  bool ready() const { return false; }
+  void start() {}
+  model stop() { return {}; }
+#endif
+};
+
+/// Runs `f` `o.warmup` times, then times `o.reps` runs of it, where the environment overrides `o`
+///
+/// With `BENCH_COUNTERS=1`, the hardware counters of the CPU are read around the timed repetitions,
+/// which are otherwise timed in the same way, and those of the GPU count extra runs after them.
+template <class F>
+result run(std::string name, model work, F &&f, options o = {}) {
+  o = from_env(o);
+  result r{std::move(name), work, o.warmup, {}, false, {}};
+  for (int it = 0; it < o.warmup; ++it) f();
+  std::optional<counters> c;
+  if (counters::enabled()) c.emplace();
+#if !defined(_NVHPC_STDPAR_GPU)
+  if (c && c->ready()) c->start();
+#endif
+  for (int it = 0; it < o.reps; ++it) {
+    auto start = clock::now();
+    f();
+    r.add(seconds_since(start));
+  }
+  if (c && c->ready()) {
+#if defined(_NVHPC_STDPAR_GPU) && defined(USE_CUPTI)
+    auto m = c->count(f);
+    r.counted = m.bytes > 0. || m.flops > 0.;
+    r.measured = m;
+#else
+    auto m = c->stop();
+    r.counted = true;
+    r.measured = {m.bytes / o.reps, m.flops / o.reps};
+#endif
+  }
+  return r;
+}
+
+/// Compiler that the binary was built with
+inline std::string compiler() {
+  std::ostringstream s;
+#if defined(__NVCOMPILER)
+  s << "nvc++ " << __NVCOMPILER_MAJOR__ << "." << __NVCOMPILER_MINOR__;
+#elif defined(__clang__)
+  s << "clang++ " << __clang_major__ << "." << __clang_minor__;
+#elif defined(__GNUC__)
+  s << "g++ " << __GNUC__ << "." << __GNUC_MINOR__;
+#else
+  s << "unknown";
+#endif
+  return s.str();
+}
+
+/// Device that the parallel algorithms of the binary run on
+inline std::string_view device() {
+#if defined(_NVHPC_STDPAR_GPU)
+  return "gpu";
+#else
+  return "cpu";
+#endif
+}
+
+/// Peak bandwidth in [GB/s] and throughput in [GFLOP/s] of the machine, from the `BENCH_PEAK_GBS`
+/// and `BENCH_PEAK_GFLOPS` environment variables, or 0 if unknown
+struct peak {
+  double gbs = 0.;
+  double gflops = 0.;
+};
+inline peak machine_peak() {
+  peak p;
+  if (auto e = std::getenv("BENCH_PEAK_GBS")) p.gbs = std::stod(e);
+  if (auto e = std::getenv("BENCH_PEAK_GFLOPS")) p.gflops = std::stod(e);
+  return p;
+}
+
+/// Position of the median repetition of a kernel on the roofline of the machine, from its hardware
+/// counts if counted, and from its model otherwise, without FLOP events, or for the bytes of
+/// last-level cache read misses, which are not the DRAM traffic; the shares are 0 if the peaks are
+/// unknown
+struct roofline {
+  double gbs = 0., gflops = 0.;   // Achieved bandwidth [GB/s] and throughput [GFLOP/s]
+  double bandwidth_share = 0.;    // Share of the peak bandwidth
+  double intensity = 0.;          // Arithmetic intensity [FLOP/B]
+  double attainable = 0.;         // min(peak throughput, intensity * peak bandwidth) [GFLOP/s]
+  double share = 0.;              // Share of the attainable throughput
+  bool memory_bound = true;       // Whether the bandwidth bounds the attainable throughput
+
+  roofline(result const &r, peak p) {
+    auto bytes = r.counted && counters::bytes_kind == "dram" ? r.measured.bytes : r.work.bytes;
+    auto flops = r.counted && r.measured.flops > 0. ? r.measured.flops : r.work.flops;
+    gbs = bytes * 1e-9 / r.median();
+    gflops = flops * 1e-9 / r.median();
+    if (p.gbs > 0.) bandwidth_share = gbs / p.gbs;
+    if (bytes > 0.) intensity = flops / bytes;
+    if (p.gbs > 0. && p.gflops > 0. && intensity > 0.) {
+      memory_bound = intensity * p.gbs < p.gflops;
+      attainable = std::min(p.gflops, intensity * p.gbs);
+      share = gflops / attainable;
+    }
+  }
+};
+
+/// Report format, from the `BENCH_FORMAT` environment variable
+enum class format { text, json, csv };
+inline format output_format() {
+  auto e = std::getenv("BENCH_FORMAT");
+  if (e == nullptr || std::string_view(e) == "text") return format::text;
+  if (std::string_view(e) == "json") return format::json;
+  if (std::string_view(e) == "csv") return format::csv;
+  std::cerr << "ERROR: BENCH_FORMAT=" << e << " is not one of text, json, csv" << std::endl;
+  std::abort();
+}
+
+/// Quotes `s` as a JSON string, escaping `"` and `\`, which names of kernels do not usually need
+inline std::string json_string(std::string_view s) {
+  std::string q = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') q += '\\';
+    q += c;
+  }
+  return q + "\"";
+}
+
+/// Quotes `s` as a CSV field (RFC 4180), doubling `"`
+inline std::string csv_field(std::string_view s) {
+  std::string q = "\"";
+  for (char c : s) {
+    if (c == '"') q += '"';
+    q += c;
+  }
+  return q + "\"";
+}
+
+/// Formats `x` as a JSON number, or as `null` if it is not finite, e.g., the bandwidth of a result
+/// without repetitions or with a zero median
+inline std::string json_number(double x) {
+  if (!std::isfinite(x)) return "null";
+  std::ostringstream s;
+  s << x;
+  return s.str();
+}
+
+/// Formats `x` as a CSV field, which is empty if `x` is not finite
+inline std::string csv_number(double x) { return std::isfinite(x) ? json_number(x) : ""; }
+
+/// Writes `r` to `BENCH_OUTPUT`, or to `stderr`, in the format of `BENCH_FORMAT`
+inline void report(result const &r) {
+  roofline const rl(r, machine_peak());
+  std::ostringstream s;
+  switch (output_format()) {
+  case format::text:
+    s << r.name << ": " << r.seconds.size() << " reps, min " << r.min() << " s, median " << r.median()
+      << " s, p95 " << r.p95() << " s";
+    if (r.work.bytes > 0.) s << ", Bandwidth [GB/s]: " << r.gbs();
+    if (r.work.flops > 0.) s << ", [GFLOP/s]: " << r.gflops();
+    if (r.counted && counters::bytes_kind == "dram") s << ", counted DRAM [GB/s]: " << rl.gbs;
+    if (r.counted && counters::bytes_kind == "llc_read_miss") s << ", LLC read-miss bytes: " << r.measured.bytes;
+    if (r.counted && r.measured.flops > 0.) s << ", counted [GFLOP/s]: " << rl.gflops;
+    if (rl.bandwidth_share > 0.) s << ", " << 100. * rl.bandwidth_share << "% of peak bandwidth";
+    if (rl.attainable > 0.) {
+      s << ", roofline: " << rl.intensity << " FLOP/B, " << (rl.memory_bound ? "memory" : "compute")
+        << "-bound, " << 100. * rl.share << "% of " << rl.attainable << " GFLOP/s";
+    }
+    s << "\n";
+    break;
+  case format::json: {
+    auto n = json_number;
+    s << "{\"name\": " << json_string(r.name) << ", \"compiler\": " << json_string(compiler())
+      << ", \"device\": " << json_string(device()) << ", \"warmup\": " << r.warmup
+      << ", \"reps\": " << r.seconds.size() << ", \"min_s\": " << n(r.min()) << ", \"median_s\": " << n(r.median())
+      << ", \"p95_s\": " << n(r.p95()) << ", \"bytes\": " << n(r.work.bytes) << ", \"flops\": " << n(r.work.flops)
+      << ", \"gbs\": " << n(r.gbs()) << ", \"gflops\": " << n(r.gflops())
+      << ", \"counted\": " << (r.counted ? "true" : "false") << ", \"counted_bytes\": " << n(r.measured.bytes)
+      << ", \"counted_bytes_kind\": " << json_string(counters::bytes_kind)
+      << ", \"counted_flops\": " << n(r.measured.flops) << ", \"bandwidth_share\": " << n(rl.bandwidth_share)
+      << ", \"intensity\": " << n(rl.intensity) << ", \"attainable_gflops\": " << n(rl.attainable)
+      << ", \"roofline_share\": " << n(rl.share) << "}\n";
+    break;
+  }
+  case format::csv: {
+    auto n = csv_number;
+    s << csv_field(r.name) << "," << csv_field(compiler()) << "," << csv_field(device()) << "," << r.warmup << ","
+      << r.seconds.size() << "," << n(r.min()) << "," << n(r.median()) << "," << n(r.p95()) << "," << n(r.work.bytes)
+      << "," << n(r.work.flops) << "," << n(r.gbs()) << "," << n(r.gflops()) << "," << r.counted << ","
+      << n(r.measured.bytes) << "," << csv_field(counters::bytes_kind) << "," << n(r.measured.flops) << "," << n(rl.bandwidth_share) << "," << n(rl.intensity)
+      << "," << n(rl.attainable) << "," << n(rl.share) << "\n";
+    break;
+  }
+  }
+  // The CSV header starts a new or empty BENCH_OUTPUT file, or the first report of the process to
+  // stderr, such that appending the reports of several runs to one file keeps a single header:
+  constexpr char const *csv_header = "name,compiler,device,warmup,reps,min_s,median_s,p95_s,bytes,flops,gbs,gflops,"
+                                     "counted,counted_bytes,counted_bytes_kind,counted_flops,bandwidth_share,intensity,"
+                                     "attainable_gflops,roofline_share\n";
+  bool const csv = output_format() == format::csv;
+  if (auto path = std::getenv("BENCH_OUTPUT")) {
+    std::error_code ec;
+    bool const empty = !std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0;
+    std::ofstream f(path, std::ios::app);
+    if (csv && empty) f << csv_header;
+    f << s.str();
+  } else {
+    static bool header = true;
+    if (csv && header) std::cerr << csv_header;
+    header = false;
+    std::cerr << s.str() << std::flush;
+  }
+}
+
+} // namespace benchmark
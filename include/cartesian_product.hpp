@@ -156,9 +156,12 @@ express Statement of Purpose.
 */
 
 #include <algorithm>
+#include <array>
 #include <concepts>
+#include <cstdint>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <ranges>
 #include <tuple>
 #include <type_traits>
@@ -1358,356 +1361,152 @@ namespace tl  {
    };
 
 #ifndef DISABLE_CART_PROD_IOTA_SPEC
-  template <typename W, typename B>
-  requires std::is_integral_v<W> && std::is_integral_v<B>
-   class cartesian_product_view<
-        std::ranges::iota_view<W, B>, 
-        std::ranges::iota_view<W, B>,
-        std::ranges::iota_view<W, B>
-    >
-      : public std::ranges::view_interface<
-            cartesian_product_view<
-                std::ranges::iota_view<W, B>,
-                std::ranges::iota_view<W, B>,
-                std::ranges::iota_view<W, B>
-            >
-        > {
-
-    using self = cartesian_product_view<
-            std::ranges::iota_view<W, B>,
-            std::ranges::iota_view<W, B>,
-            std::ranges::iota_view<W, B>
-    >;
-   public:
-     W x_b, y_b, z_b;
-     B nx, ny, nz;
-   private:
-
-      template <bool Const>
-      class cursor;
-
-      template <bool Const>
-      class cursor {
-	W x_i, y_i, z_i, x_0, y_0, z_0;
-	B nx, ny, nz;
-
-      public:
-	using reference = std::tuple<W const&, W const&, W const&>;
-	using value_type = std::tuple<W, W, W>;
-
-         using difference_type = std::ptrdiff_t;
-
-         cursor() = default;
-         constexpr explicit cursor(
-             W x,
-             W y,
-	     W z,
-             B nx, 
-             B ny,
-	     B nz) 
-        : 
-            x_i(x),
-            y_i(y),
-	    z_i(z),
-            x_0(x),
-            y_0(y),
-	    z_0(z),
-            nx(nx), 
-            ny(ny),
-	    nz(nz)
-        {}
-
-        constexpr decltype(auto) read() const {
-	  return std::make_tuple<W const&, W const&, W const&>(x_i, y_i, z_i); 
-        }
-	constexpr auto linear() const {
-	  return (z_i - z_0) + nz * (y_i - y_0) + nz * ny * (x_i - x_0);
-	}
-
-        void advance(difference_type n) {
-     	    auto idx = linear() + n;
-            x_i = idx / (nz * ny) + x_0;
-            y_i = (idx / nz) % ny + y_0;
-	    z_i = idx % nz + z_0;
-	}
-         void next() {
-            //advance(1);
-             ++z_i;
-            if (z_i == (z_0 + nz)) {
-                z_i = z_0;
-                ++y_i;
-		if (y_i == (y_0 + ny)) {
-		  y_i = y_0;
-		  ++x_i;
-		}
-            }
-         }
-         void prev(){
-            advance(-1);
-         }
-
-         constexpr bool equal(const cursor& rhs) const {
-             return x_i == rhs.x_i && y_i == rhs.y_i && z_i == rhs.z_i;
-         }
-
-         constexpr auto distance_to(cursor const& other) const {
-	   auto idx = linear();
-	   auto oidx = other.linear();
-           return static_cast<difference_type>(oidx) - static_cast<difference_type>(idx);
+   namespace detail {
+      // Exact n / d for 32-bit n and d via one multiply-high by m = ceil(2^64 / d)
+      // (Lemire, Kaser & Kurz, "Faster Remainder by Direct Computation", 2019).
+      struct fast_divisor {
+         std::uint64_t m = 0; // 0 encodes d == 1
+         std::uint32_t d = 1;
+
+         fast_divisor() = default;
+         constexpr explicit fast_divisor(std::uint32_t d)
+            : m(d > 1 ? std::numeric_limits<std::uint64_t>::max() / d + 1 : 0), d(d) {}
+
+         constexpr std::uint32_t divide(std::uint32_t n) const {
+#if defined(__SIZEOF_INT128__)
+            auto q = static_cast<std::uint32_t>((static_cast<unsigned __int128>(m) * n) >> 64);
+            return m == 0 ? n : q;
+#else
+            return n / d;
+#endif
          }
-
-         friend class cursor<!Const>;
       };
+   }
 
-   public:
-      cartesian_product_view() = default;
-      constexpr explicit cartesian_product_view(
-          std::ranges::iota_view<W, B> xs,
-          std::ranges::iota_view<W, B> ys,
-	  std::ranges::iota_view<W, B> zs
-      ) : x_b(*std::ranges::begin(xs))
-        , y_b(*std::ranges::begin(ys))
-	, z_b(*std::ranges::begin(zs))
-        , nx(std::ranges::size(xs))
-        , ny(std::ranges::size(ys))
-	, nz(std::ranges::size(zs))	  
-    {}
-
-      constexpr auto begin() {
-	return basic_iterator{ cursor<false>(x_b, y_b, z_b, nx, ny, nz) };
-      }
-      constexpr auto begin() const {
-	return basic_iterator{ cursor<true>(x_b, y_b, z_b, nx, ny, nz) };
-      }
-
-      constexpr auto size() {
-         return nx * ny * nz;
-      }
-
-      constexpr auto size() const {
-         return nx * ny * nz;
-      }
-
-      constexpr auto end() {
-         return begin() + size();
-      }
-
-      constexpr auto end() const {
-	 return begin() + size();
-      }
-   };
-  
-  template <typename W, typename B>
-  requires std::is_integral_v<W> && std::is_integral_v<B>
-   class cartesian_product_view<
-        std::ranges::iota_view<W, B>, 
-        std::ranges::iota_view<W, B>
-    >
+   // Fast path for 1D, 2D and 3D products of bounded integral iota_views, i.e., the
+   // index spaces of the stencil and daxpy kernels. The cursor keeps both the
+   // coordinates and their linear index into the row-major product, whose strides
+   // are computed once by the view. next(), which serial loops execute, updates the
+   // coordinates with a carry chain, and read() returns references to them. The
+   // random-access operations that parallel backends use to split the range are
+   // O(1) on the linear index: equal/distance_to compare it, and advance() decodes
+   // the coordinates from it; when the product fits in 32 bits, the decode uses a
+   // precomputed 64-bit reciprocal per stride instead of a division.
+   template <typename W, typename B, typename... Vs>
+   requires std::is_integral_v<W> && std::is_integral_v<B>
+      && (sizeof...(Vs) < 3) && (std::same_as<Vs, std::ranges::iota_view<W, B>> && ...)
+   class cartesian_product_view<std::ranges::iota_view<W, B>, Vs...>
       : public std::ranges::view_interface<
-            cartesian_product_view<
-                std::ranges::iota_view<W, B>, 
-                std::ranges::iota_view<W, B>
-            >
+            cartesian_product_view<std::ranges::iota_view<W, B>, Vs...>
         > {
 
-    using self = cartesian_product_view<
-            std::ranges::iota_view<W, B>, 
-            std::ranges::iota_view<W, B>
-    >;
-   public:
-     W x_b, y_b;
-     B nx, ny;
-   private:
+      static constexpr std::size_t rank = 1 + sizeof...(Vs);
 
-      template <bool Const>
-      class cursor;
+      struct shape {
+         std::array<W, rank> origin{};
+         std::array<W, rank> last{};                // origin + extent
+         std::array<std::ptrdiff_t, rank> stride{}; // stride[rank - 1] == 1
+         std::array<detail::fast_divisor, rank> reciprocal{};
+         bool narrow = true;                        // size() <= UINT32_MAX
+      };
 
       template <bool Const>
       class cursor {
-	W x_i, y_i, x_0, y_0;
-	B nx, ny;
-
-      public:
-         using reference = std::tuple<W const&, W const&>;
-         using value_type = std::tuple<W, W>;
-
-         using difference_type = std::ptrdiff_t;
-
-         cursor() = default;
-         constexpr explicit cursor(
-             W x,
-             W y,
-             B nx, 
-             B ny) 
-        : 
-            x_i(x),
-            y_i(y),
-            x_0(x),
-            y_0(y),
-            nx(nx), 
-            ny(ny)
-        {}
-
-        constexpr decltype(auto) read() const {
-            return std::make_tuple<W const&, W const&>(x_i, y_i); 
-        }
-	constexpr auto linear() const {
-	  return (y_i - y_0) + ny * (x_i - x_0);
-	}
-
-        void advance(difference_type n) {
-     	    auto idx = linear() + n;
-            x_i = idx / ny + x_0;
-            y_i = idx % ny + y_0;
-         }
-         void next() {
-            //advance(1);
-             ++y_i;
-            if (y_i == (y_0 + ny)) {
-                y_i = y_0;
-                ++x_i;
+         std::ptrdiff_t i_ = 0;
+         std::array<W, rank> x_{};
+         shape s_;
+
+         template <class U>
+         constexpr void decode() {
+            auto r = static_cast<U>(i_);
+            for (std::size_t d = 0; d + 1 < rank; ++d) {
+               auto const s = static_cast<U>(s_.stride[d]);
+               U q;
+               if constexpr (sizeof(U) == sizeof(std::uint32_t)) q = s_.reciprocal[d].divide(r);
+               else q = r / s;
+               r -= q * s;
+               x_[d] = s_.origin[d] + static_cast<W>(q);
             }
-         }
-         void prev(){
-            advance(-1);
+            x_[rank - 1] = s_.origin[rank - 1] + static_cast<W>(r);
          }
 
-         constexpr bool equal(const cursor& rhs) const {
-             return x_i == rhs.x_i && y_i == rhs.y_i;
-         }
-
-         constexpr auto distance_to(cursor const& other) const {
-	   auto idx = linear();
-	   auto oidx = other.linear();
-	   return static_cast<difference_type>(oidx) - static_cast<difference_type>(idx);	   
+         constexpr void seek() {
+            if constexpr (rank == 1) x_[0] = s_.origin[0] + static_cast<W>(i_);
+            else if (s_.narrow) decode<std::uint32_t>();
+            else decode<std::uint64_t>();
          }
 
-         friend class cursor<!Const>;
-      };
-
-   public:
-      cartesian_product_view() = default;
-      constexpr explicit cartesian_product_view(
-          std::ranges::iota_view<W, B> xs,
-          std::ranges::iota_view<W, B> ys
-      ) : x_b(*std::ranges::begin(xs))
-        , y_b(*std::ranges::begin(ys))
-        , nx(std::ranges::size(xs))
-        , ny(std::ranges::size(ys))
-    {}
-
-      constexpr auto begin() {
-         return basic_iterator{ cursor<false>(x_b, y_b, nx, ny) };
-      }
-      constexpr auto begin() const {
-         return basic_iterator{ cursor<true>(x_b, y_b, nx, ny) };
-      }
-
-      constexpr auto size() {
-         return nx * ny;
-      }
-
-      constexpr auto size() const {
-         return nx * ny;
-      }
-
-      constexpr auto end() {
-         return begin() + size();
-      }
-
-      constexpr auto end() const {
-	 return begin() + size();
-      }
-     
-   };
-
-  template <typename W, typename B>
-  requires std::is_integral_v<W> && std::is_integral_v<B>
-   class cartesian_product_view<
-        std::ranges::iota_view<W, B>
-    >
-      : public std::ranges::view_interface<
-            cartesian_product_view<
-                std::ranges::iota_view<W, B>
-            >
-        > {
-
-     int x_i, x_e;
-
-      template <bool Const>
-      class cursor;
-
-      template <bool Const>
-      class cursor {
-	long x_i, x_e;
-
       public:
-         using reference = std::tuple<int const&>;
-         using value_type = std::tuple<int>;
-
+         using value_type = std::tuple<W, std::ranges::range_value_t<Vs>...>;
          using difference_type = std::ptrdiff_t;
 
          cursor() = default;
-         constexpr explicit cursor(
-             int x, int x_e) 
-        : 
-            x_i(x),
-            x_e(x_e)
-        {}
-
-        constexpr decltype(auto) read() const {
-            return std::make_tuple<int const&>(x_i); 
-        }
-        void advance(difference_type n) {
-	  x_i += n;
+         constexpr explicit cursor(std::ptrdiff_t i, shape const& s) : i_(i), s_(s) { seek(); }
+
+         constexpr auto read() const {
+            return std::apply([](auto const&... c) { return std::tuple<decltype(c)...>{c...}; }, x_);
          }
-         void next() {
-            advance(1);
+
+         constexpr void advance(difference_type n) {
+            i_ += n;
+            seek();
          }
-         void prev(){
-            advance(-1);
+         constexpr void next() {
+            ++i_;
+            // The outermost coordinate is not wrapped, such that the end cursor is (last[0], origin...):
+            for (std::size_t d = rank - 1; d > 0; --d) {
+               if (++x_[d] != s_.last[d]) return;
+               x_[d] = s_.origin[d];
+            }
+            ++x_[0];
          }
+         constexpr void prev() { advance(-1); }
 
          constexpr bool equal(const cursor& rhs) const {
-	   return x_i == rhs.x_i;
+            return i_ == rhs.i_;
          }
 
-         constexpr auto distance_to(cursor const& other) const {
-            return static_cast<difference_type>(other.x_i - x_i);
+         constexpr difference_type distance_to(cursor const& other) const {
+            return other.i_ - i_;
          }
 
          friend class cursor<!Const>;
       };
 
+      shape s_;
+      std::ptrdiff_t n_ = 0;
+
    public:
       cartesian_product_view() = default;
-      constexpr explicit cartesian_product_view(
-          std::ranges::iota_view<W, B> xs
-      ) : x_i(*std::ranges::begin(xs))
-        , x_e(*std::ranges::begin(xs) + std::ranges::size(xs))
-    {}
-
-      constexpr auto begin() {
-         return basic_iterator{ cursor<false>(x_i, x_e) };
-      }
-      constexpr auto begin() const {
-         return basic_iterator{ cursor<true>(x_i, x_e) };
-      }
-
-      constexpr auto size() {
-         return x_e - x_i;
+      constexpr explicit cartesian_product_view(std::ranges::iota_view<W, B> xs, Vs... vs) {
+         s_.origin = {*std::ranges::begin(xs), *std::ranges::begin(vs)...};
+         std::array<std::ptrdiff_t, rank> const extents{
+            static_cast<std::ptrdiff_t>(std::ranges::size(xs)),
+            static_cast<std::ptrdiff_t>(std::ranges::size(vs))...};
+         for (std::size_t d = 0; d < rank; ++d)
+            s_.last[d] = s_.origin[d] + static_cast<W>(extents[d]);
+         n_ = 1;
+         for (std::size_t d = rank; d-- > 0;) {
+            s_.stride[d] = n_;
+            n_ *= extents[d];
+         }
+         s_.narrow = n_ <= static_cast<std::ptrdiff_t>(std::numeric_limits<std::uint32_t>::max());
+         if (s_.narrow) {
+            for (std::size_t d = 0; d < rank; ++d)
+               s_.reciprocal[d] = detail::fast_divisor(static_cast<std::uint32_t>(s_.stride[d]));
+         }
       }
 
-      constexpr auto size() const {
-         return x_e - x_i;
+      constexpr auto begin() const {
+         return basic_iterator{ cursor<true>(0, s_) };
       }
 
-      constexpr auto end() {
-         return begin() + size();
+      constexpr auto end() const {
+         return basic_iterator{ cursor<true>(n_, s_) };
       }
 
-      constexpr auto end() const {
-	 return begin() + size();
+      constexpr std::size_t size() const {
+         return static_cast<std::size_t>(n_);
       }
    };
 #endif // DISABLE_CART_PROD_IOTA_SPEC
@@ -1723,39 +1522,13 @@ namespace tl  {
                return {};
             }
 #ifndef DISABLE_CART_PROD_IOTA_SPEC
- 	    template <typename W, typename B>
-            constexpr auto operator()(
-                std::ranges::iota_view<W, B> xs
-            ) const {
-               return tl::cartesian_product_view<
-                std::ranges::iota_view<W, B>
-               >{ std::move(xs) };
-            }
-
- 	    template <typename W, typename B>
-            constexpr auto operator()(
-                std::ranges::iota_view<W, B> xs, 
-                std::ranges::iota_view<W, B> ys
-            ) const {
-               return tl::cartesian_product_view<
-                std::ranges::iota_view<W, B>,
-                std::ranges::iota_view<W, B>
-               >{ std::move(xs), std::move(ys) };
+            template <typename W, typename B, typename... Vs>
+            requires (sizeof...(Vs) < 3) && (std::same_as<Vs, std::ranges::iota_view<W, B>> && ...)
+            constexpr auto operator()(std::ranges::iota_view<W, B> xs, Vs... vs) const {
+               return tl::cartesian_product_view<std::ranges::iota_view<W, B>, Vs...>{
+                  std::move(xs), std::move(vs)... };
             }
- 	    template <typename W, typename B>
-            constexpr auto operator()(
-                std::ranges::iota_view<W, B> xs, 
-                std::ranges::iota_view<W, B> ys,
-                std::ranges::iota_view<W, B> zs		
-            ) const {
-               return tl::cartesian_product_view<
-                std::ranges::iota_view<W, B>,
-		std::ranges::iota_view<W, B>,		 
-                std::ranges::iota_view<W, B>
-               >{ std::move(xs), std::move(ys), std::move(zs) };
-            }
-	   
-#endif	   
+#endif
             template <std::ranges::viewable_range... V>
             requires ((std::ranges::forward_range<V> && ...) && (sizeof...(V) != 0))
                constexpr auto operator()(V&&... vs) const {
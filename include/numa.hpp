@@ -0,0 +1,190 @@
+#pragma once
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! NUMA helpers for the bandwidth benchmarks of the labs.
+//!
+//! On multi-socket CPUs, Linux places each page on the NUMA node of the thread that touches it
+//! first. `std::vector<double> x(n, 0.)` value-initializes `x` sequentially, which places all of
+//! its pages on the node of the main thread, and the parallel kernels then read most of them
+//! remotely. These helpers:
+//!
+//! - `numa::vector<T>`: a vector whose allocator leaves elements uninitialized, such that the first
+//!   parallel pass over it touches its pages first.
+//! - `numa::first_touch(s)`: such a first parallel pass, with the same "for_each_n" over element
+//!   indices, and thus the same partition of the elements among the threads, as the kernels.
+//! - `numa::pin_threads()`: pins the threads of the parallel algorithms to distinct CPUs if the
+//!   environment variable `PIN_THREADS=1` is set, such that they do not migrate away from the pages
+//!   they touched first.
+//! - `numa::report(name, spans)`: reports which share of the pages of the given spans is placed on
+//!   each NUMA node. It measures no bandwidth: for that, run the kernel bound to each node, e.g.,
+//!   with `numactl --cpunodebind`.
+//!
+//! NOTE: on the GPU, `numa::pin_threads()` does nothing; managed memory pages migrate to the
+//! processor that accesses them instead.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <execution>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace numa {
+
+/// Allocator that default-initializes the elements that `std::vector` would value-initialize,
+/// which leaves elements of trivial types uninitialized and their pages untouched.
+template <class T>
+struct no_init_allocator : std::allocator<T> {
+  using value_type = T;
+  template <class U>
+  struct rebind {
+    using other = no_init_allocator<U>;
+  };
+
+  no_init_allocator() = default;
+  template <class U>
+  no_init_allocator(no_init_allocator<U> const &) noexcept {}
+
+  template <class U>
+  void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new ((void *)p) U;
+  }
+  template <class U, class... Args>
+  void construct(U *p, Args &&...args) {
+    ::new ((void *)p) U(std::forward<Args>(args)...);
+  }
+};
+
+/// Vector that leaves its elements uninitialized on construction and on "resize"
+template <class T>
+using vector = std::vector<T, no_init_allocator<T>>;
+
+/// Sets the elements of `s` to `value` in parallel, touching the pages of `s` with the threads that
+/// process the same elements in the parallel "for_each_n" loops of the kernels
+template <class T>
+void first_touch(std::span<T> s, T value = T{}) {
+  std::for_each_n(std::execution::par, std::views::iota(std::size_t(0)).begin(), s.size(),
+                  [value, s = s.data()](std::size_t i) { s[i] = value; });
+}
+
+/// Whether the environment variable `PIN_THREADS=1` enables thread pinning
+inline bool pinning() {
+  auto e = std::getenv("PIN_THREADS");
+  return e != nullptr && std::string_view(e) == "1";
+}
+
+/// Pins each thread of the parallel algorithms that joins a parallel loop to its own CPU, in the
+/// order of the CPUs that the process may run on, if `pinning()`.
+///
+/// NOTE: threads join the loop on a best-effort basis: the loop sleeps shortly in each iteration,
+/// which lets the idle threads of the pool steal iterations. The threads of `nvc++
+/// -stdpar=multicore` are OpenMP threads, which `OMP_PROC_BIND=close` also pins.
+inline void pin_threads() {
+#if defined(__linux__) && !defined(_NVHPC_STDPAR_GPU)
+  if (!pinning()) return;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    std::cerr << "ERROR: failed to query the CPU affinity of the process" << std::endl;
+    std::abort();
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+  }
+  std::atomic<std::size_t> next = 0;
+  std::for_each_n(std::execution::par, std::views::iota(std::size_t(0)).begin(), 64 * cpus.size(),
+                  [&](std::size_t) {
+                    thread_local bool pinned = false;
+                    if (!pinned) {
+                      pinned = true;
+                      cpu_set_t set;
+                      CPU_ZERO(&set);
+                      CPU_SET(cpus[next++ % cpus.size()], &set);
+                      sched_setaffinity(0, sizeof(set), &set);
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                  });
+  std::cerr << "Pinned " << next.load() << " threads to " << cpus.size() << " CPUs" << std::endl;
+#endif
+}
+
+/// Number of pages of the spans of `s` on each NUMA node, sampled at up to `max_samples` pages per
+/// span. Empty if the system does not report the placement of pages.
+inline std::vector<long> pages_per_node(std::initializer_list<std::span<std::byte const>> s,
+                                        long max_samples = 4096) {
+  std::vector<long> counts;
+#if defined(__linux__)
+  auto page = (std::uintptr_t)sysconf(_SC_PAGESIZE);
+  for (auto bytes : s) {
+    if (bytes.empty()) continue;
+    auto first = (std::uintptr_t)bytes.data() / page;
+    auto last = ((std::uintptr_t)bytes.data() + bytes.size() - 1) / page;
+    long npages = (long)(last - first + 1), nsamples = std::min(npages, max_samples);
+    std::vector<void *> pages(nsamples);
+    std::vector<int> status(nsamples);
+    for (long i = 0; i < nsamples; ++i) pages[i] = (void *)((first + i * npages / nsamples) * page);
+    // Without target nodes, "move_pages" only queries the node of each page:
+    if (syscall(SYS_move_pages, 0, nsamples, pages.data(), nullptr, status.data(), 0) != 0) return {};
+    for (auto node : status) {
+      if (node < 0) continue; // Not yet touched, or not accessible
+      if (node >= (int)counts.size()) counts.resize(node + 1);
+      ++counts[node];
+    }
+  }
+#endif
+  return counts;
+}
+
+/// Reports the share of the pages of the spans of `s`, which kernel `name` accesses, that is placed
+/// on each NUMA node
+inline void report(char const *name, std::initializer_list<std::span<std::byte const>> s) {
+  auto counts = pages_per_node(s);
+  long total = 0;
+  for (auto c : counts) total += c;
+  if (total == 0) return;
+  std::cerr << name << " page placement:";
+  for (std::size_t node = 0; node < counts.size(); ++node) {
+    std::cerr << " node " << node << ": " << 100. * counts[node] / total << "% of the pages;";
+  }
+  std::cerr << std::endl;
+}
+
+} // namespace numa
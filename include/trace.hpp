@@ -0,0 +1,63 @@
+#pragma once
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! NVTX ranges that name the phases of the labs in Nsight Systems timelines.
+//!
+//! Ranges are only emitted when compiling with `-DUSE_NVTX`, which requires the NVTX3 headers
+//! (ci/recipe.py installs them into /usr/include/nvtx3). Otherwise, `trace::range` is an empty
+//! type with empty inline constructors and destructors, that the compiler removes entirely.
+//!
+//! - `trace::range r("name")`: pushes the range "name" on construction and pops it on
+//!   destruction, on the calling thread.
+//! - `r.next("other")`: pops the range of `r` and pushes the range "other" in its place, which
+//!   names consecutive phases of a function without introducing a scope for each of them.
+//!
+//! NOTE: NVTX ranges belong to host threads. Annotate the host code that calls the parallel
+//! algorithms, not the element functions passed to them, since these may run on the GPU.
+
+#if defined(USE_NVTX)
+#include <nvtx3/nvToolsExt.h>
+#endif
+
+namespace trace {
+
+/// Scoped NVTX range
+struct range {
+#if defined(USE_NVTX)
+  explicit range(char const *name) noexcept { nvtxRangePushA(name); }
+  ~range() { nvtxRangePop(); }
+  void next(char const *name) noexcept {
+    nvtxRangePop();
+    nvtxRangePushA(name);
+  }
+#else
+  constexpr explicit range(char const *) noexcept {}
+  ~range() {}
+  constexpr void next(char const *) noexcept {}
+#endif
+  range(range const &) = delete;
+  range &operator=(range const &) = delete;
+};
+
+} // namespace trace
@@ -30,6 +30,7 @@
 #include <ranges>
 #include <algorithm>
 #include <execution>
+#include <bench.hpp>
 // TODO: include mdspan
 // #include <mdspan>
 
@@ -95,20 +96,14 @@ int main(int argc, char *argv[]) {
 
   std::cerr << "Check: OK, ";
 
-  // Measure bandwidth in [GB/s]
-  using clk_t = std::chrono::steady_clock;
-  daxpy(a, x, y);
-  auto start = clk_t::now();
-  int nit = 100;
-  for (int it = 0; it < nit; ++it) {
-    daxpy(a, x, y);
-  }
-  auto seconds = std::chrono::duration<double>(clk_t::now() - start).count(); // Duration in [s]
-  // Amount of bytes transferred from/to chip.
-  // x is read, y is read and written:
-  auto gigabytes = 3. * (double)x.size() * (double)sizeof(double) * (double)nit * 1.e-9; // GB
+  // Measure bandwidth in [GB/s]. x is read, y is read and written, and each element takes
+  // a multiply and an add:
+  auto bytes = 3. * (double)x.size() * (double)sizeof(double);
+  auto r = benchmark::run("daxpy", {bytes, 2. * (double)x.size()}, [&] { daxpy(a, x, y); },
+                          {.warmup = 1, .reps = 100});
   auto sz_gb = 2. * (double)x.size() * (double)sizeof(double) * 1e-9;
-  std::cerr << "Problem size: " << sz_gb << " [GB], Bandwidth [GB/s]: " << (gigabytes / seconds) << std::endl;
+  std::cerr << "Problem size: " << sz_gb << " [GB]" << std::endl;
+  benchmark::report(r);
 
   return 0;
 }
@@ -0,0 +1,114 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Variant of exercise5 with NUMA-aware memory placement.
+//!
+//! `x` and `y` are `numa::vector`s, which `main` does not initialize, such that the parallel
+//! `initialize` touches their pages first, with the same partition of the elements among the
+//! threads as `daxpy`. Set `PIN_THREADS=1` to pin the threads to distinct CPUs.
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <ranges>
+#include <algorithm>
+#include <execution>
+#include <numa.hpp>
+#include <bench.hpp>
+#include <trace.hpp>
+
+/// Intialize vectors `x` and `y`: parallel algorithm version
+void initialize(numa::vector<double> &x, numa::vector<double> &y) {
+  assert(x.size() == y.size());
+  // First touch of the pages of x and y: "for_each_n" over the same indices as "daxpy", and "fill_n":
+  std::for_each_n(std::execution::par, std::views::iota(0).begin(), x.size(), [x = x.data()](int i) {
+    x[i] = (double)i;
+  });
+  std::fill_n(std::execution::par, y.data(), y.size(), 2.);
+}
+
+/// DAXPY: AX + Y: parallel algorithm version
+void daxpy(double a, numa::vector<double> const &x, numa::vector<double> &y) {
+  trace::range r("daxpy");
+  assert(x.size() == y.size());
+  std::for_each_n(std::execution::par,
+                  std::views::iota(0).begin(), x.size(), 
+    [a, x = x.data(), y = y.data()](int i) {
+        y[i] += a * x[i];
+  });
+}
+
+// Check solution
+bool check(double a, numa::vector<double> const &y);
+
+int main(int argc, char *argv[]) {
+  // Read CLI arguments, the first argument is the name of the binary:
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+
+  // Read length of vector elements
+  long long n = std::stoll(argv[1]);
+
+  // Pin the threads before they touch any memory, and allocate the vectors without initializing them:
+  numa::pin_threads();
+  numa::vector<double> x(n), y(n);
+  double a = 2.0;
+
+  initialize(x, y);
+
+  daxpy(a, x, y);
+
+  if (!check(a, y)) {
+    std::cerr << "ERROR!" << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Check: OK, ";
+
+  // Measure bandwidth in [GB/s]. x is read, y is read and written, and each element takes
+  // a multiply and an add:
+  auto bytes = 3. * (double)x.size() * (double)sizeof(double);
+  auto r = benchmark::run("daxpy", {bytes, 2. * (double)x.size()}, [&] { daxpy(a, x, y); },
+                          {.warmup = 1, .reps = 100});
+  auto sz_gb = 2. * (double)x.size() * (double)sizeof(double) * 1e-9;
+  std::cerr << "Problem size: " << sz_gb << " [GB]" << std::endl;
+  benchmark::report(r);
+  numa::report("daxpy", {std::as_bytes(std::span(x)), std::as_bytes(std::span(y))});
+
+  return 0;
+}
+
+bool check(double a, numa::vector<double> const &y) {
+  double tolerance = 2. * std::numeric_limits<double>::epsilon();
+  for (std::size_t i = 0; i < y.size(); ++i) {
+    double should = a * i + 2.;
+    if (std::abs(y[i] - should) > tolerance)
+      return false;
+  }
+  return true;
+}
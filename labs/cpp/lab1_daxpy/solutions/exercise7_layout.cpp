@@ -0,0 +1,202 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Variant of exercise7 with a 2D DAXPY that accepts any strided `mdspan` layout.
+//!
+//! `daxpy` picks the iteration order from the strides of `y`, such that the innermost index is the
+//! one of smallest stride, i.e., accesses stay unit-stride for `layout_right`, for `layout_left`,
+//! and for `layout_stride` sub-blocks of larger matrices, like the column-major slices of Fortran
+//! arrays. On the CPU, each thread walks whole rows or columns; on the GPU, consecutive threads
+//! access consecutive elements. `daxpy_tiled` splits the matrices into tiles with `submdspan`.
+//!
+//! Usage: ./exercise7_layout <n>   (n must be divisible by 64, the number of columns)
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <mdspan>
+#include <numeric>
+#include <ranges>
+#include <string>
+#include <utility>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+/// 2D DAXPY: AX + Y, with the columns of `ys` innermost if `ColMajor`, and its rows otherwise
+template <bool ColMajor, class XS, class YS>
+void daxpy_ordered(double a, XS xs, YS ys) {
+  std::size_t nslow = ColMajor ? ys.extent(1) : ys.extent(0);
+  std::size_t nfast = ColMajor ? ys.extent(0) : ys.extent(1);
+  auto kernel = [=](std::size_t slow, std::size_t fast) {
+    if constexpr (ColMajor) {
+      ys(fast, slow) += a * xs(fast, slow);
+    } else {
+      ys(slow, fast) += a * xs(slow, fast);
+    }
+  };
+#if defined(_NVHPC_STDPAR_GPU)
+  std::for_each_n(std::execution::par_unseq, std::views::iota(std::size_t(0)).begin(), nslow * nfast,
+                  [=](std::size_t i) { kernel(i / nfast, i % nfast); });
+#else
+  std::for_each_n(std::execution::par, std::views::iota(std::size_t(0)).begin(), nslow,
+                  [=](std::size_t slow) {
+                    for (std::size_t fast = 0; fast < nfast; ++fast) kernel(slow, fast);
+                  });
+#endif
+}
+
+/// Whether the elements of each column of `m` are closer together than the elements of each row
+template <class M>
+bool column_major(M const &m) {
+  return m.stride(0) < m.stride(1);
+}
+
+/// Aborts if `xs` and `ys` have different extents
+template <class XS, class YS>
+void check_extents(XS const &xs, YS const &ys) {
+  if (xs.extent(0) != ys.extent(0) || xs.extent(1) != ys.extent(1)) {
+    std::cerr << "ERROR: daxpy of a " << xs.extent(0) << "x" << xs.extent(1) << " x and a " << ys.extent(0)
+              << "x" << ys.extent(1) << " y" << std::endl;
+    std::abort();
+  }
+}
+
+/// 2D DAXPY: AX + Y for any strided layouts of `xs` and `ys`.
+///
+/// NOTE: the iteration order follows the layout of `y`, which is both read and written.
+template <class XS, class YS>
+void daxpy(double a, XS xs, YS ys) {
+  trace::range r("daxpy");
+  check_extents(xs, ys);
+  if (column_major(ys)) {
+    daxpy_ordered<true>(a, xs, ys);
+  } else {
+    daxpy_ordered<false>(a, xs, ys);
+  }
+}
+
+/// 2D DAXPY: AX + Y over `tile` x `tile` sub-blocks of `xs` and `ys` obtained with `submdspan`,
+/// processing the tiles in parallel, and the elements of each tile sequentially, in layout order.
+template <class XS, class YS>
+void daxpy_tiled(double a, XS xs, YS ys, std::size_t tile) {
+  trace::range r("daxpy_tiled");
+  check_extents(xs, ys);
+  std::size_t nrows = ys.extent(0), ncols = ys.extent(1);
+  std::size_t ntrows = (nrows + tile - 1) / tile, ntcols = (ncols + tile - 1) / tile;
+  bool col_major = column_major(ys);
+  std::for_each_n(std::execution::par, std::views::iota(std::size_t(0)).begin(), ntrows * ntcols,
+                  [=](std::size_t t) {
+                    // Consecutive tiles are adjacent along the dimension of smallest stride:
+                    std::size_t tr = col_major ? t % ntrows : t / ntcols;
+                    std::size_t tc = col_major ? t / ntrows : t % ntcols;
+                    auto rows = std::pair{tr * tile, std::min(nrows, (tr + 1) * tile)};
+                    auto cols = std::pair{tc * tile, std::min(ncols, (tc + 1) * tile)};
+                    auto xt = std::submdspan(xs, rows, cols);
+                    auto yt = std::submdspan(ys, rows, cols);
+                    if (col_major) {
+                      for (std::size_t c = 0; c < yt.extent(1); ++c)
+                        for (std::size_t r = 0; r < yt.extent(0); ++r) yt(r, c) += a * xt(r, c);
+                    } else {
+                      for (std::size_t r = 0; r < yt.extent(0); ++r)
+                        for (std::size_t c = 0; c < yt.extent(1); ++c) yt(r, c) += a * xt(r, c);
+                    }
+                  });
+}
+
+// Check that all elements of `ys` equal `should`, and that the `y` elements outside of `ys` are zero
+template <class YS>
+bool check(std::vector<double> const &y, YS ys, double should);
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+  long n = std::stol(argv[1]);
+  std::size_t ncols = 64;
+  if (n <= 0 || n % ncols != 0) {
+    std::cerr << "ERROR: length " << n << " not divisible by " << ncols << std::endl;
+    return 1;
+  }
+  std::size_t nrows = n / ncols;
+  double a = 2.0;
+
+  // The strided matrices are the leading nrows x ncols block of nrows + pad x ncols column-major
+  // arrays, i.e., of leading dimension "ld":
+  std::size_t pad = 8, ld = nrows + pad;
+  std::vector<double> x(ld * ncols, 1.), y(ld * ncols, 0.);
+  std::dextents<std::size_t, 2> extents(nrows, ncols);
+  auto right = std::layout_right::mapping(extents);
+  auto left = std::layout_left::mapping(extents);
+  auto strided = std::layout_stride::mapping(extents, std::array<std::size_t, 2>{1, ld});
+
+  auto report = [&](char const *name, auto ys, auto &&f) {
+    std::fill_n(std::execution::par, y.data(), y.size(), 0.);
+    // x is read, y is read and written, and each element takes a multiply and an add:
+    auto n = (double)(nrows * ncols);
+    auto r = benchmark::run(name, {3. * n * sizeof(double), 2. * n}, f, {.warmup = 1, .reps = 20});
+    if (!check(y, ys, a * (r.warmup + (double)r.seconds.size()))) {
+      std::cerr << "ERROR! " << name << std::endl;
+      std::exit(1);
+    }
+    benchmark::report(r);
+  };
+  std::cerr << "Problem size: " << 2. * nrows * ncols * sizeof(double) * 1e-9 << " [GB], " << nrows << "x"
+            << ncols << " matrices" << std::endl;
+  {
+    std::mdspan<double const, std::dextents<std::size_t, 2>, std::layout_right> xs{x.data(), right};
+    std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right> ys{y.data(), right};
+    report("layout_right", ys, [&] { daxpy(a, xs, ys); });
+  }
+  {
+    std::mdspan<double const, std::dextents<std::size_t, 2>, std::layout_left> xs{x.data(), left};
+    std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_left> ys{y.data(), left};
+    report("layout_left, rows innermost", ys, [&] { daxpy_ordered<false>(a, xs, ys); });
+    report("layout_left", ys, [&] { daxpy(a, xs, ys); });
+  }
+  {
+    std::mdspan<double const, std::dextents<std::size_t, 2>, std::layout_stride> xs{x.data(), strided};
+    std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_stride> ys{y.data(), strided};
+    report("layout_stride sub-block", ys, [&] { daxpy(a, xs, ys); });
+    report("layout_stride sub-block, 256x256 tiles", ys, [&] { daxpy_tiled(a, xs, ys, 256); });
+  }
+  std::cerr << "Check: OK" << std::endl;
+  return 0;
+}
+
+template <class YS>
+bool check(std::vector<double> const &y, YS ys, double should) {
+  double tolerance = 2. * std::numeric_limits<double>::epsilon();
+  double sum = 0.;
+  for (std::size_t r = 0; r < ys.extent(0); ++r)
+    for (std::size_t c = 0; c < ys.extent(1); ++c) {
+      if (std::abs(ys(r, c) - should) > tolerance * should) return false;
+      sum += ys(r, c);
+    }
+  // The elements outside of `ys` are zero if all elements of `y` sum up to those of `ys`:
+  return std::reduce(y.begin(), y.end()) == sum;
+}
@@ -0,0 +1,185 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Micro-benchmark of `std::views::cartesian_product` against raw nested loops.
+//!
+//! Runs DAXPY over a 2D (n/1024 x 1024) and a 3D (n/4096 x 64 x 64) index space with:
+//! - nested loops: a parallel loop over the outermost dimension with serial inner loops,
+//! - the iota fast path of `cartesian_product` (a carry-chain cursor with O(1) random access),
+//! - the generic `cartesian_product` (over materialized index vectors).
+//!
+//! The `cartesian_product` timed here is the C++20 backport of `<cartesian_product.hpp>`, which
+//! provides the iota fast paths. Under C++23 the standard library's own view would be measured, so
+//! this file must be built with `-std=c++20`, e.g.:
+//!   g++ -std=c++20 -Ofast -march=native -DNDEBUG -I../../../include -o exercise8_bench solutions/exercise8_bench.cpp -ltbb
+//!
+//! Usage: ./exercise8_bench <n>   (n must be divisible by 4096)
+
+#if __cplusplus > 202002L
+#error "exercise8_bench measures the <cartesian_product.hpp> backport: build it with -std=c++20"
+#endif
+
+#include <algorithm>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <ranges>
+#include <string>
+#include <vector>
+#include <cartesian_product.hpp> // Brings C++23 std::views::cartesian_product to C++20
+#include <bench.hpp>
+
+/// Number of DAXPYs that `bandwidth` performed, including warm-up runs
+long ndaxpys = 0;
+
+/// Benchmarks `f`, a DAXPY over `n` elements, as kernel `name`, reports it, and returns its bandwidth in [GB/s]
+template <class F>
+double bandwidth(char const* name, long n, F&& f) {
+  // x is read, y is read and written, and each element takes a multiply and an add:
+  auto r = benchmark::run(name, {3. * (double)n * (double)sizeof(double), 2. * (double)n}, f,
+                          {.warmup = 1, .reps = 20});
+  benchmark::report(r);
+  ndaxpys += r.warmup + (long)r.seconds.size();
+  return r.gbs();
+}
+
+/// Materializes [0, n) so that `cartesian_product` takes the generic path
+std::vector<int> indices(int n) {
+  std::vector<int> v(n);
+  std::copy_n(std::views::iota(0).begin(), n, v.begin());
+  return v;
+}
+
+void bench_2d(double a, std::vector<double>& x, std::vector<double>& y) {
+  int ny = 1024, nx = x.size() / ny;
+  auto xp = x.data(), yp = y.data();
+  auto is_x = indices(nx), is_y = indices(ny);
+
+  auto nested = [&] {
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), nx, [=](int i) {
+      for (int j = 0; j < ny; ++j) yp[i * ny + j] += a * xp[i * ny + j];
+    });
+  };
+  auto fast = [&] {
+    auto is = std::views::cartesian_product(std::views::iota(0, nx), std::views::iota(0, ny));
+    std::for_each(std::execution::par, is.begin(), is.end(), [=](auto idx) {
+      auto [i, j] = idx;
+      yp[i * ny + j] += a * xp[i * ny + j];
+    });
+  };
+  auto slow = [&] {
+    auto is = std::views::cartesian_product(is_x, is_y);
+    std::for_each(std::execution::par, is.begin(), is.end(), [=](auto idx) {
+      auto [i, j] = idx;
+      yp[i * ny + j] += a * xp[i * ny + j];
+    });
+  };
+
+  auto bw_nested = bandwidth("2D nested loops", x.size(), nested);
+  auto bw_fast = bandwidth("2D cartesian_product (iota)", x.size(), fast);
+  auto bw_slow = bandwidth("2D cartesian_product (generic)", x.size(), slow);
+  std::cerr << "2D " << nx << "x" << ny << " Bandwidth [GB/s]: "
+            << "nested loops: " << bw_nested << ", cartesian_product (iota): " << bw_fast
+            << ", cartesian_product (generic): " << bw_slow << std::endl;
+}
+
+void bench_3d(double a, std::vector<double>& x, std::vector<double>& y) {
+  int ny = 64, nz = 64, nx = x.size() / (ny * nz);
+  auto xp = x.data(), yp = y.data();
+  auto is_x = indices(nx), is_y = indices(ny), is_z = indices(nz);
+
+  auto nested = [&] {
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), nx, [=](int i) {
+      for (int j = 0; j < ny; ++j)
+        for (int k = 0; k < nz; ++k) {
+          auto l = (i * ny + j) * nz + k;
+          yp[l] += a * xp[l];
+        }
+    });
+  };
+  auto fast = [&] {
+    auto is = std::views::cartesian_product(std::views::iota(0, nx), std::views::iota(0, ny),
+                                            std::views::iota(0, nz));
+    std::for_each(std::execution::par, is.begin(), is.end(), [=](auto idx) {
+      auto [i, j, k] = idx;
+      auto l = (i * ny + j) * nz + k;
+      yp[l] += a * xp[l];
+    });
+  };
+  auto slow = [&] {
+    auto is = std::views::cartesian_product(is_x, is_y, is_z);
+    std::for_each(std::execution::par, is.begin(), is.end(), [=](auto idx) {
+      auto [i, j, k] = idx;
+      auto l = (i * ny + j) * nz + k;
+      yp[l] += a * xp[l];
+    });
+  };
+
+  auto bw_nested = bandwidth("3D nested loops", x.size(), nested);
+  auto bw_fast = bandwidth("3D cartesian_product (iota)", x.size(), fast);
+  auto bw_slow = bandwidth("3D cartesian_product (generic)", x.size(), slow);
+  std::cerr << "3D " << nx << "x" << ny << "x" << nz << " Bandwidth [GB/s]: "
+            << "nested loops: " << bw_nested << ", cartesian_product (iota): " << bw_fast
+            << ", cartesian_product (generic): " << bw_slow << std::endl;
+}
+
+// Check solution after `nit` DAXPYs
+bool check(double a, std::vector<double> const& y, long nit);
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+  long n = std::stol(argv[1]);
+  if (n <= 0 || n % 4096 != 0) {
+    std::cerr << "ERROR: length " << n << " not divisible by 4096" << std::endl;
+    return 1;
+  }
+
+  std::vector<double> x(n, 1.), y(n, 0.);
+  double a = 2.0;
+
+  bench_2d(a, x, y);
+  if (!check(a, y, ndaxpys)) {
+    std::cerr << "ERROR!" << std::endl;
+    return 1;
+  }
+  std::fill_n(std::execution::par, y.data(), y.size(), 0.);
+  ndaxpys = 0;
+  bench_3d(a, x, y);
+  if (!check(a, y, ndaxpys)) {
+    std::cerr << "ERROR!" << std::endl;
+    return 1;
+  }
+  std::cerr << "Check: OK" << std::endl;
+  return 0;
+}
+
+bool check(double a, std::vector<double> const& y, long nit) {
+  double tolerance = 2. * std::numeric_limits<double>::epsilon();
+  double should = a * nit;
+  for (std::size_t i = 0; i < y.size(); ++i)
+    if (std::abs(y[i] - should) > tolerance * should) return false;
+  return true;
+}
@@ -0,0 +1,188 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! BLAS-1 kernels built on the parallel algorithms of the DAXPY exercises.
+//!
+//! - `axpy`: y = a x + y, and `axpby`: y = a x + b y, with "transform".
+//! - `dot`: x . y, and `nrm2`: ||x||_2, with "transform_reduce".
+//! - `axpy_dot`: y = a x + y followed by y . z, fused into one pass, which reads `y` once instead of
+//!   twice, i.e., 4 instead of 5 vector transfers.
+//! - batched `axpy`: y_b = a_b x_b + y_b for many small vectors, stored as the rows of two `mdspan`s,
+//!   in one launch over the `cartesian_product` of the batch and vector indices, instead of one
+//!   launch per vector.
+//!
+//! Usage: ./exercise8_blas1 <n>   (n must be divisible by 256, the length of the batched vectors)
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <mdspan>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <string>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+/// y = a x + y
+void axpy(double a, std::vector<double> const &x, std::vector<double> &y) {
+  trace::range r("axpy");
+  std::transform(std::execution::par, x.begin(), x.end(), y.begin(), y.begin(),
+                 [a](double xi, double yi) { return a * xi + yi; });
+}
+
+/// y = a x + b y
+void axpby(double a, std::vector<double> const &x, double b, std::vector<double> &y) {
+  trace::range r("axpby");
+  std::transform(std::execution::par, x.begin(), x.end(), y.begin(), y.begin(),
+                 [a, b](double xi, double yi) { return a * xi + b * yi; });
+}
+
+/// x . y
+double dot(std::vector<double> const &x, std::vector<double> const &y) {
+  trace::range r("dot");
+  return std::transform_reduce(std::execution::par, x.begin(), x.end(), y.begin(), 0.);
+}
+
+/// ||x||_2
+///
+/// NOTE: unlike the reference BLAS, the squares are not scaled, and overflow for |x_i| > 1e154.
+double nrm2(std::vector<double> const &x) {
+  trace::range r("nrm2");
+  return std::sqrt(std::transform_reduce(std::execution::par, x.begin(), x.end(), 0., std::plus{},
+                                         [](double xi) { return xi * xi; }));
+}
+
+/// y = a x + y, and returns y . z, in one pass over x, y, and z
+double axpy_dot(double a, std::vector<double> const &x, std::vector<double> &y,
+                std::vector<double> const &z) {
+  trace::range r("axpy_dot");
+  auto is = std::views::iota(0, (int)x.size());
+  return std::transform_reduce(std::execution::par, is.begin(), is.end(), 0., std::plus{},
+                               [a, x = x.data(), y = y.data(), z = z.data()](int i) {
+                                 double yi = a * x[i] + y[i];
+                                 y[i] = yi;
+                                 return yi * z[i];
+                               });
+}
+
+/// y_b = a_b x_b + y_b for the rows x_b and y_b of `xs` and `ys`, in one launch
+void axpy(std::span<double const> as, std::mdspan<double const, std::dextents<int, 2>> xs,
+          std::mdspan<double, std::dextents<int, 2>> ys) {
+  trace::range r("batched axpy");
+  if (xs.extent(0) != ys.extent(0) || xs.extent(1) != ys.extent(1) || as.size() != (size_t)xs.extent(0)) {
+    std::cerr << "ERROR: batched axpy of " << as.size() << " scalars, " << xs.extent(0) << "x"
+              << xs.extent(1) << " x and " << ys.extent(0) << "x" << ys.extent(1) << " y" << std::endl;
+    std::abort();
+  }
+  auto is = std::views::cartesian_product(std::views::iota(0, xs.extent(0)),
+                                          std::views::iota(0, xs.extent(1)));
+  std::for_each(std::execution::par, is.begin(), is.end(), [=, as = as.data()](auto idx) {
+    auto [b, i] = idx;
+    ys(b, i) += as[b] * xs(b, i);
+  });
+}
+
+/// Benchmarks `f` as kernel `name`, which transfers `nvectors` vectors of `n` elements and performs
+/// `flops` operations per element, reports it, and returns its bandwidth in [GB/s]
+template <class F>
+double bandwidth(char const *name, long n, int nvectors, double flops, F &&f) {
+  auto r = benchmark::run(name, {(double)nvectors * (double)n * (double)sizeof(double), flops * (double)n}, f,
+                          {.warmup = 1, .reps = 20});
+  benchmark::report(r);
+  return r.gbs();
+}
+
+// Check that all elements of `y` equal `should`
+bool check(std::vector<double> const &y, double should);
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+  long n = std::stol(argv[1]);
+  int const m = 256;
+  if (n <= 0 || n % m != 0) {
+    std::cerr << "ERROR: length " << n << " not divisible by " << m << std::endl;
+    return 1;
+  }
+
+  std::vector<double> x(n, 1.), y(n, 0.), z(n, 2.);
+  double a = 2.0;
+
+  // Check each kernel once:
+  axpy(a, x, y);
+  bool ok = check(y, 2.);
+  axpby(a, x, 0.5, y);
+  ok = ok && check(y, 3.);
+  ok = ok && dot(x, y) == 3. * n && nrm2(z) == 2. * std::sqrt((double)n);
+  ok = ok && axpy_dot(a, x, y, z) == 10. * n && check(y, 5.);
+  int nbatch = n / m;
+  std::vector<double> as(nbatch, a);
+  std::mdspan<double const, std::dextents<int, 2>> xs{x.data(), nbatch, m};
+  std::mdspan<double, std::dextents<int, 2>> ys{y.data(), nbatch, m};
+  axpy(as, xs, ys);
+  ok = ok && check(y, 7.);
+  if (!ok) {
+    std::cerr << "ERROR!" << std::endl;
+    return 1;
+  }
+  std::cerr << "Check: OK, Problem size: " << (double)n * sizeof(double) * 1e-9 << " [GB] per vector"
+            << std::endl;
+
+  // Measure bandwidth in [GB/s], counting the vectors that each kernel reads or writes.
+  // The scalars keep the values of `y` bounded across iterations:
+  bandwidth("axpy", n, 3, 2., [&] { axpy(a, x, y); });
+  bandwidth("axpby", n, 3, 3., [&] { axpby(a, x, 0.5, y); });
+  double r = 0.;
+  bandwidth("dot", n, 2, 2., [&] { r += dot(x, y); });
+  bandwidth("nrm2", n, 1, 2., [&] { r += nrm2(x); });
+  // The effective bandwidth of both the fused and the unfused versions counts the 5 transfers of
+  // the unfused version, such that the ratio of both is the speedup of fusion:
+  auto unfused = bandwidth("axpy + dot", n, 5, 4., [&] { axpy(-a, x, y); r += dot(y, z); });
+  auto fused = bandwidth("axpy_dot", n, 5, 4., [&] { r += axpy_dot(a, x, y, z); });
+  std::cerr << "axpy_dot: " << fused / unfused << "x the bandwidth of axpy + dot" << std::endl;
+  auto per_vector = bandwidth("batched axpy, one launch per vector", n, 3, 2., [&] {
+    for (int b = 0; b < nbatch; ++b) {
+      std::transform(std::execution::par, &xs(b, 0), &xs(b, 0) + m, &ys(b, 0), &ys(b, 0),
+                     [a](double xi, double yi) { return a * xi + yi; });
+    }
+  });
+  auto batched = bandwidth("batched axpy, one launch", n, 3, 2., [&] { axpy(as, xs, ys); });
+  std::cerr << "batched axpy of " << nbatch << " vectors of " << m << " elements: one launch has "
+            << batched / per_vector << "x the bandwidth of one launch per vector" << std::endl;
+  // Keep the reductions alive:
+  if (std::isnan(r)) std::cerr << r << std::endl;
+  return 0;
+}
+
+bool check(std::vector<double> const &y, double should) {
+  double tolerance = 2. * std::numeric_limits<double>::epsilon();
+  for (std::size_t i = 0; i < y.size(); ++i)
+    if (std::abs(y[i] - should) > tolerance * should) return false;
+  return true;
+}
@@ -0,0 +1,273 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Lazy vector expressions, which fuse chains of DAXPYs into one pass.
+//!
+//! `y = a * x + b * z + y` with one `daxpy` per term performs one pass over `y` per term. Here, the
+//! arithmetic operators only build an expression type at compile time, which holds pointers to its
+//! operands, and assigning an expression to a `vec` evaluates it in a single "for_each_n" loop, such
+//! that any chain of elementwise operations reads each operand once and writes `y` once.
+//! Operands are vectors, 1D mdspans of any layout, and scalars; the vector operands of an expression
+//! must have the same size.
+//!
+//! Usage: ./exercise8_expr <n>
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <execution>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mdspan>
+#include <ranges>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+/// Elementwise expression: element `i` of `e` is `e[i]`, and `e.size()` is its number of elements.
+/// Scalars have no size, and `size()` returns 0.
+template <class E>
+concept expression = requires(E const &e, std::size_t i) {
+  { e[i] } -> std::convertible_to<double>;
+  { e.size() } -> std::convertible_to<std::size_t>;
+};
+
+/// Read-only vector operand of an expression
+struct operand {
+  double const *data;
+  std::size_t n;
+  double operator[](std::size_t i) const { return data[i]; }
+  std::size_t size() const { return n; }
+};
+
+/// Scalar operand of an expression, broadcast to all elements
+struct scalar {
+  double value;
+  double operator[](std::size_t) const { return value; }
+  std::size_t size() const { return 0; }
+};
+
+/// Read-only operand of a 1D mdspan of any layout
+template <class M>
+struct mdspan_operand {
+  M m;
+  double operator[](std::size_t i) const { return m[i]; }
+  std::size_t size() const { return m.extent(0); }
+};
+
+/// Elementwise binary operation of two expressions, whose vector operands must have the same size
+template <class Op, expression L, expression R>
+struct binary {
+  L l;
+  R r;
+
+  binary(L l, R r) : l(l), r(r) {
+    if (l.size() != 0 && r.size() != 0 && l.size() != r.size()) {
+      std::cerr << "ERROR: combining expressions of sizes " << l.size() << " and " << r.size() << std::endl;
+      std::abort();
+    }
+  }
+
+  double operator[](std::size_t i) const { return Op{}(l[i], r[i]); }
+  std::size_t size() const { return l.size() != 0 ? l.size() : r.size(); }
+};
+
+/// Vector whose elements are assigned from an expression in one pass
+struct vec {
+  double *data;
+  std::size_t n;
+
+  vec(std::vector<double> &v) : data(v.data()), n(v.size()) {}
+  template <class E, class L>
+    requires(E::rank() == 1)
+  vec(std::mdspan<double, E, L> v) : data(v.data_handle()), n(v.extent(0)) {
+    if (v.stride(0) != 1) {
+      std::cerr << "ERROR: vec of an mdspan of stride " << v.stride(0) << std::endl;
+      std::abort();
+    }
+  }
+
+  double operator[](std::size_t i) const { return data[i]; }
+  std::size_t size() const { return n; }
+
+  /// Copies the elements of `o` into this vector, which keeps viewing its own storage
+  vec &operator=(vec const &o);
+
+  /// Evaluates `e` into this vector.
+  ///
+  /// NOTE: element `i` of `e` only reads element `i` of its operands, which allows this vector to
+  /// appear in `e`, e.g., `y = a * x + y`.
+  template <expression E>
+  vec &operator=(E const &e) {
+    if (e.size() != n) {
+      std::cerr << "ERROR: assigning an expression of size " << e.size() << " to a vector of size " << n
+                << std::endl;
+      std::abort();
+    }
+    trace::range r("fused expression");
+    std::for_each_n(std::execution::par_unseq, std::views::iota(std::size_t(0)).begin(), n,
+                    [e, data = data](std::size_t i) { data[i] = e[i]; });
+    return *this;
+  }
+};
+
+/// Whether `E` is an expression node, which is cheap to copy, as opposed to a container
+template <class E>
+constexpr bool is_node = false;
+template <>
+constexpr bool is_node<operand> = true;
+template <>
+constexpr bool is_node<scalar> = true;
+template <class M>
+constexpr bool is_node<mdspan_operand<M>> = true;
+template <class Op, class L, class R>
+constexpr bool is_node<binary<Op, L, R>> = true;
+
+/// Wraps vectors and scalars into expressions, and leaves expression nodes unchanged
+inline operand lazy(std::vector<double> const &v) { return {v.data(), v.size()}; }
+inline operand lazy(vec const &v) { return {v.data, v.n}; }
+inline scalar lazy(double s) { return {s}; }
+template <class T, class E, class L, class A>
+  requires(E::rank() == 1)
+mdspan_operand<std::mdspan<T, E, L, A>> lazy(std::mdspan<T, E, L, A> v) {
+  return {v};
+}
+template <expression E>
+  requires is_node<E>
+E lazy(E const &e) {
+  return e;
+}
+
+inline vec &vec::operator=(vec const &o) { return *this = lazy(o); }
+
+/// Types that `lazy` accepts
+template <class T>
+concept lazy_operand = requires(T const &t) { lazy(t); };
+
+/// Types that expression operators are defined for: at least one of both operands must be an expression or
+/// a vector, such that arithmetic on scalars and vectors alone keeps its usual meaning
+template <class L, class R>
+concept lazy_operands = lazy_operand<L> && lazy_operand<R> &&
+                        !(std::is_arithmetic_v<L> && std::is_arithmetic_v<R>);
+
+template <class L, class R>
+  requires lazy_operands<L, R>
+auto operator+(L const &l, R const &r) {
+  return binary<std::plus<>, decltype(lazy(l)), decltype(lazy(r))>{lazy(l), lazy(r)};
+}
+template <class L, class R>
+  requires lazy_operands<L, R>
+auto operator-(L const &l, R const &r) {
+  return binary<std::minus<>, decltype(lazy(l)), decltype(lazy(r))>{lazy(l), lazy(r)};
+}
+template <class L, class R>
+  requires lazy_operands<L, R>
+auto operator*(L const &l, R const &r) {
+  return binary<std::multiplies<>, decltype(lazy(l)), decltype(lazy(r))>{lazy(l), lazy(r)};
+}
+
+/// DAXPY: AX + Y, one pass per call
+void daxpy(double a, std::vector<double> const &x, std::vector<double> &y) {
+  trace::range r("daxpy");
+  std::transform(std::execution::par_unseq, x.begin(), x.end(), y.begin(), y.begin(),
+                 [a](double xi, double yi) { return a * xi + yi; });
+}
+
+/// Benchmarks `f` as kernel `name`, which transfers `nvectors` vectors of `n` elements and performs
+/// `flops` operations per element, reports it, and returns its bandwidth in [GB/s]
+template <class F>
+double bandwidth(char const *name, long n, int nvectors, double flops, F &&f) {
+  auto r = benchmark::run(name, {(double)nvectors * (double)n * (double)sizeof(double), flops * (double)n}, f,
+                          {.warmup = 1, .reps = 20});
+  benchmark::report(r);
+  return r.gbs();
+}
+
+// Check that all elements of `y` equal `should`
+bool check(std::vector<double> const &y, double should);
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+  long n = std::stol(argv[1]);
+
+  std::vector<double> x(n, 1.), y(n, 0.), z(n, 2.), w(n, 3.);
+  double a = 2.0, b = 0.5, c = -1.0;
+
+  vec ys{y};
+  ys = a * x + b * z + y;
+  bool ok = check(y, 3.);
+  std::mdspan<double, std::dextents<long, 1>> ym{y.data(), n};
+  vec{ym} = a * x + b * z + c * w + y;
+  ok = ok && check(y, 3.);
+  ys = (x - z) * y;
+  ok = ok && check(y, -3.);
+  // mdspan operands, e.g., every other element of a vector of 2n elements:
+  std::vector<double> x2(2 * n, 1.);
+  std::layout_stride::mapping every_other{std::dextents<long, 1>{n}, std::array<long, 1>{2}};
+  std::mdspan<double const, std::dextents<long, 1>, std::layout_stride> xm{x2.data(), every_other};
+  ys = a * xm + y;
+  ok = ok && check(y, -1.);
+  // Assigning a vec copies its elements instead of rebinding the view:
+  vec ws{w};
+  ys = ws;
+  ok = ok && check(y, 3.) && ys.data == y.data();
+  if (!ok) {
+    std::cerr << "ERROR!" << std::endl;
+    return 1;
+  }
+  std::cerr << "Check: OK, Problem size: " << (double)n * sizeof(double) * 1e-9 << " [GB] per vector"
+            << std::endl;
+
+  // Measure bandwidth in [GB/s]. Both versions count the transfers of the fused version, i.e., one
+  // read per operand and one write, such that their ratio is the speedup of fusion. The chains add
+  // zero to `y`, which keeps its values bounded across iterations:
+  auto chain = bandwidth("y = a x - 2 b z + y, daxpy chain", n, 4, 4., [&] {
+    daxpy(a, x, y);
+    daxpy(-2. * b, z, y);
+  });
+  auto fused = bandwidth("y = a x - 2 b z + y, fused", n, 4, 4., [&] { ys = a * x - 2. * b * z + y; });
+  std::cerr << "y = a x - 2 b z + y: fused has " << fused / chain << "x the bandwidth of the daxpy chain"
+            << std::endl;
+  chain = bandwidth("y = a x + b z + c w + y, daxpy chain", n, 5, 6., [&] {
+    daxpy(a, x, y);
+    daxpy(b, z, y);
+    daxpy(c, w, y);
+  });
+  fused = bandwidth("y = a x + b z + c w + y, fused", n, 5, 6., [&] { ys = a * x + b * z + c * w + y; });
+  std::cerr << "y = a x + b z + c w + y: fused has " << fused / chain << "x the bandwidth of the daxpy chain"
+            << std::endl;
+  return 0;
+}
+
+bool check(std::vector<double> const &y, double should) {
+  double tolerance = 2. * std::numeric_limits<double>::epsilon();
+  for (std::size_t i = 0; i < y.size(); ++i)
+    if (std::abs(y[i] - should) > tolerance * std::abs(should)) return false;
+  return true;
+}
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <random>
 #include <ranges>
+#include <bench.hpp>
 
 // Select elements from "v" using "pred" and copy them to "w".
 template <class UnaryPredicate>
@@ -92,16 +93,9 @@ void initialize(std::vector<int>& v)
 
 template <typename Predicate>
 void bench(std::vector<int>& v, Predicate&& predicate, std::vector<size_t>& index, std::vector<int>& w) {
-    // Measure bandwidth in [GB/s]
-    using clk_t = std::chrono::steady_clock;
-    select(v, predicate, index, w);
-    auto start = clk_t::now();
-    int nit = 10;
-    for (int it = 0; it < nit; ++it) {
-        select(v, predicate, index, w);
-    }
-    auto seconds = std::chrono::duration<double>(clk_t::now() - start).count(); // Duration in [s]
-    // Bandwith for a memcpy:
-    auto gigabytes = 2. * sizeof(int) * (double)v.size() * 1.e-9; // GB
-    std::cerr << "Problem size: " << gigabytes << " GB, Bandwidth [GB/s]: " << (gigabytes * (double)nit / seconds) << std::endl;
+    // Measure bandwidth in [GB/s], for the bytes of a memcpy of "v":
+    auto bytes = 2. * sizeof(int) * (double)v.size();
+    auto r = benchmark::run("select", {bytes, 0.}, [&] { select(v, predicate, index, w); }, {.warmup = 1, .reps = 10});
+    std::cerr << "Problem size: " << bytes * 1.e-9 << " GB" << std::endl;
+    benchmark::report(r);
 }
@@ -30,6 +30,8 @@
 #include <random>
 #include <ranges>
 #include <execution>
+#include <bench.hpp>
+#include <trace.hpp>
 
 // Select elements and copy them to a new vector
 template<class UnaryPredicate>
@@ -38,6 +40,7 @@ void select(const std::vector<int>& v, UnaryPredicate pred,
 {
     index.resize(v.size());
     w.resize(v.size());
+    trace::range r("copy_if");
     std::copy_if(std::execution::par, v.begin(), v.end(), w.begin(), pred);
 }
 
@@ -91,16 +94,9 @@ void initialize(std::vector<int>& v)
 
 template <typename Predicate>
 void bench(std::vector<int>& v, Predicate&& predicate, std::vector<size_t>& index, std::vector<int>& w) {
-    // Measure bandwidth in [GB/s]
-    using clk_t = std::chrono::steady_clock;
-    select(v, predicate, index, w);
-    auto start = clk_t::now();
-    int nit = 10;
-    for (int it = 0; it < nit; ++it) {
-        select(v, predicate, index, w);
-    }
-    auto seconds = std::chrono::duration<double>(clk_t::now() - start).count(); // Duration in [s]
-    // Bandwith for a memcpy:
-    auto gigabytes = 2. * sizeof(int) * (double)v.size() * 1.e-9; // GB
-    std::cerr << "Problem size: " << gigabytes << " GB, Bandwidth [GB/s]: " << (gigabytes * (double)nit / seconds) << std::endl;
+    // Measure bandwidth in [GB/s], for the bytes of a memcpy of "v":
+    auto bytes = 2. * sizeof(int) * (double)v.size();
+    auto r = benchmark::run("select", {bytes, 0.}, [&] { select(v, predicate, index, w); }, {.warmup = 1, .reps = 10});
+    std::cerr << "Problem size: " << bytes * 1.e-9 << " GB" << std::endl;
+    benchmark::report(r);
 }
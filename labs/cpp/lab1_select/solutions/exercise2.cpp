@@ -30,6 +30,8 @@
 #include <random>
 #include <ranges>
 #include <execution>
+#include <bench.hpp>
+#include <trace.hpp>
 
 // Select elements and copy them to a new vector
 template<class UnaryPredicate>
@@ -39,12 +41,14 @@ void select(const std::vector<int>& v, UnaryPredicate pred,
     // DONE: Resize `index` to the same size as `v`.
     index.resize(v.size());
     // DONE: use parallel `transform_inclusive_scan` to write to `index` the indices at which each selected element is to be written.
+    trace::range r("scan");
     std::transform_inclusive_scan(std::execution::par, v.begin(), v.end(), index.begin(), std::plus<size_t>{},
                                   [pred](int x) { return pred(x) ? 1 : 0; });
     // DONE: Resize the output `w`. The total number of output elements is the last value of the `inclusive_scan` (i.e. `index.back()`).
     w.resize(index.empty() ? 0 : index.back());
     // DONE: Use parallel `for_each` statement to copy values from `v` to `w`, depending on the outcome of the unary predicate. 
     // The output index of each element is off by plus one, so need to subtract one from it.
+    r.next("scatter");
     std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)v.size(),
         [pred, v = v.data(), w = w.data(), index = index.data()](int i) {
             if (pred(v[i])) w[index[i] - 1] = v[i];
@@ -101,16 +105,9 @@ void initialize(std::vector<int>& v)
 
 template <typename Predicate>
 void bench(std::vector<int>& v, Predicate&& predicate, std::vector<size_t>& index, std::vector<int>& w) {
-    // Measure bandwidth in [GB/s]
-    using clk_t = std::chrono::steady_clock;
-    select(v, predicate, index, w);
-    auto start = clk_t::now();
-    int nit = 10;
-    for (int it = 0; it < nit; ++it) {
-        select(v, predicate, index, w);
-    }
-    auto seconds = std::chrono::duration<double>(clk_t::now() - start).count(); // Duration in [s]
-    // Bandwith for a memcpy:
-    auto gigabytes = 2. * sizeof(int) * (double)v.size() * 1.e-9; // GB
-    std::cerr << "Problem size: " << gigabytes << " GB, Bandwidth [GB/s]: " << (gigabytes * (double)nit / seconds) << std::endl;
+    // Measure bandwidth in [GB/s], for the bytes of a memcpy of "v":
+    auto bytes = 2. * sizeof(int) * (double)v.size();
+    auto r = benchmark::run("select", {bytes, 0.}, [&] { select(v, predicate, index, w); }, {.warmup = 1, .reps = 10});
+    std::cerr << "Problem size: " << bytes * 1.e-9 << " GB" << std::endl;
+    benchmark::report(r);
 }
@@ -0,0 +1,556 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 University of Geneva. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Variant of exercise2 comparing stream compaction algorithms for "select":
+//!
+//! - copy_if: parallel "count_if" & "copy_if" algorithms, as in exercise1, which read `v` twice.
+//! - scan+scatter: parallel "transform_inclusive_scan" into `index` and "for_each_n" scatter, as in
+//!   exercise2, which additionally write and read `index`, 8 bytes per element.
+//! - look-back: single-pass decoupled look-back, which splits `v` into tiles, and writes the
+//!   selected elements of a tile to `w` as soon as the number of elements that the preceding tiles
+//!   select is known, without an O(n) index buffer.
+//! - mask: two passes, where the first pass packs the predicate results into one bit per element
+//!   and computes 32-bit offsets of each 64-element block, and the second pass replays the mask,
+//!   such that the predicate is only evaluated once per element.
+//!
+//! The workspace overload of "mask" does not allocate: like CUB algorithms, it reports the size of
+//! the scratch memory it needs up front, and writes to caller-owned spans, such that repeated
+//! calls do not initialize memory or, on the GPU, fault managed memory pages back and forth.
+//!
+//! The workspace overload is also benchmarked on `numa::vector`s, whose pages are first touched by
+//! the threads of the parallel algorithms instead of the main thread, see `numa.hpp`.
+//!
+//! `partition_by` generalizes "select" to `k` buckets: it stably partitions `v` by a classifier,
+//! e.g., into the selected elements and their complement, or into classes of keys, evaluating
+//! the classifier once per element, instead of calling "select" once per bucket. It writes the
+//! buckets one after the other, so it reads `v` twice. `partition_lookback` writes each bucket to
+//! its own output instead, and reads `v` once, with the decoupled look-back of "look-back" on
+//! `k`-wide tile prefixes.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <vector>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <numa.hpp>
+#include <random>
+#include <ranges>
+#include <span>
+#include <bench.hpp>
+#include <trace.hpp>
+
+// Select elements from "v" using "pred" and copy them to "w" with "count_if" & "copy_if".
+template <class UnaryPredicate>
+void select_copy_if(const std::vector<int>& v, UnaryPredicate pred,
+                    std::vector<size_t>&, std::vector<int>& w)
+{
+    trace::range r("count");
+    auto count = std::count_if(std::execution::par, v.begin(), v.end(), pred);
+    w.resize(count);
+    r.next("copy");
+    std::copy_if(std::execution::par, v.begin(), v.end(), w.begin(), pred);
+}
+
+// Select elements from "v" using "pred" and copy them to "w" with a scan into "index" and a scatter.
+template <class UnaryPredicate>
+void select_scan(const std::vector<int>& v, UnaryPredicate pred,
+                 std::vector<size_t>& index, std::vector<int>& w)
+{
+    index.resize(v.size());
+    trace::range r("scan");
+    std::transform_inclusive_scan(std::execution::par, v.begin(), v.end(), index.begin(), std::plus<size_t>{},
+                                  [pred](int x) { return pred(x) ? 1 : 0; });
+    w.resize(index.empty() ? 0 : index.back());
+    r.next("scatter");
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)v.size(),
+        [pred, v = v.data(), w = w.data(), index = index.data()](int i) {
+            if (pred(v[i])) w[index[i] - 1] = v[i];
+    });
+}
+
+// Number of elements of the tiles of the look-back algorithm: tiles are processed sequentially by
+// one thread, and are re-read from cache to copy the selected elements.
+#if defined(_NVHPC_STDPAR_GPU)
+constexpr size_t tile_size = 128;
+#else
+constexpr size_t tile_size = 16384;
+#endif
+
+// Status of a tile of the look-back algorithm, packed with a count of selected elements into one
+// 64-bit word: the count is either the "aggregate" of the tile itself, or the inclusive "prefix"
+// of the tile and all preceding tiles.
+enum tile_status : std::uint64_t { invalid = 0, aggregate = 1, prefix = 2 };
+
+// Select elements from "v" using "pred" and copy them to "w" in a single pass. "w" must hold
+// "v.size()" elements, like the output of the workspace overload of "select_mask" below, and need not
+// be initialized. Returns the number of selected elements.
+template <class UnaryPredicate>
+size_t select_lookback(std::span<const int> v, UnaryPredicate pred, std::span<int> w)
+{
+    auto const n = v.size();
+    if (w.size() < n) {
+        std::cerr << "ERROR: select_lookback needs " << n << " output elements, not " << w.size() << std::endl;
+        std::terminate();
+    }
+    auto const ntiles = (n + tile_size - 1) / tile_size;
+    // One status per tile, and a counter that hands out the tiles in order: a tile then only waits
+    // on tiles that threads have already started, which guarantees forward progress under "par".
+    std::vector<std::atomic<std::uint64_t>> status(ntiles + 1);
+    trace::range r("look-back");
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)ntiles,
+        [pred, n, ntiles, v = v.data(), w = w.data(), status = status.data()](int) {
+            auto const tile = status[ntiles].fetch_add(1, std::memory_order_relaxed);
+            auto const b = tile * tile_size;
+            auto const e = std::min(n, b + tile_size);
+
+            // Count the selected elements of the tile and publish them:
+            std::uint64_t count = 0;
+            for (auto i = b; i < e; ++i) count += pred(v[i]) ? 1 : 0;
+            status[tile].store(count << 2 | (tile == 0 ? prefix : aggregate), std::memory_order_release);
+
+            // Look back at the preceding tiles, adding their counts up to the first inclusive prefix:
+            std::uint64_t offset = 0;
+            for (auto j = tile; j-- > 0;) {
+                std::uint64_t s;
+                while (((s = status[j].load(std::memory_order_acquire)) & 3) == invalid);
+                offset += s >> 2;
+                if ((s & 3) == prefix) break;
+            }
+            if (tile > 0) status[tile].store((offset + count) << 2 | prefix, std::memory_order_release);
+
+            // Copy the selected elements of the tile to their final position:
+            for (auto i = b; i < e; ++i) {
+                if (pred(v[i])) w[offset++] = v[i];
+            }
+    });
+    return ntiles == 0 ? 0 : status[ntiles - 1].load(std::memory_order_relaxed) >> 2;
+}
+
+// Select elements from "v" using "pred" and copy them to "w", evaluating "pred" once per element.
+//
+// NOTE: the 32-bit offsets limit "v" to 2^32 elements.
+template <class UnaryPredicate>
+void select_mask(const std::vector<int>& v, UnaryPredicate pred,
+                 std::vector<size_t>&, std::vector<int>& w)
+{
+    auto const n = v.size();
+    auto const nblocks = (n + 63) / 64;
+    std::vector<std::uint64_t> mask(nblocks);
+    std::vector<std::uint32_t> offsets(nblocks);
+
+    // Pass one: pack the predicate results of each block of 64 elements into one word. The loop has
+    // no branches, which lets CPU compilers vectorize it into compare & movemask instructions.
+    trace::range r("mask");
+    std::for_each_n(std::execution::par_unseq, std::views::iota(0).begin(), (int)nblocks,
+        [pred, n, v = v.data(), mask = mask.data()](int block) {
+            auto const b = (size_t)block * 64;
+            auto const e = std::min(n, b + 64);
+            std::uint64_t m = 0;
+            for (auto i = b; i < e; ++i) m |= std::uint64_t(pred(v[i]) ? 1 : 0) << (i - b);
+            mask[block] = m;
+    });
+    r.next("scan");
+    std::transform_exclusive_scan(std::execution::par, mask.begin(), mask.end(), offsets.begin(),
+                                  std::uint32_t(0), std::plus<std::uint32_t>{},
+                                  [](std::uint64_t m) { return (std::uint32_t)std::popcount(m); });
+    w.resize(nblocks == 0 ? 0 : offsets.back() + std::popcount(mask.back()));
+
+    // Pass two: copy the elements of the set bits of each block to their final position.
+    r.next("scatter");
+    std::for_each_n(std::execution::par_unseq, std::views::iota(0).begin(), (int)nblocks,
+        [v = v.data(), w = w.data(), mask = mask.data(), offsets = offsets.data()](int block) {
+            auto o = offsets[block];
+            for (auto m = mask[block]; m != 0; m &= m - 1) {
+                w[o++] = v[(size_t)block * 64 + std::countr_zero(m)];
+            }
+    });
+}
+
+// Number of bytes of the workspace of "select_mask" for "n" elements: one mask word and one offset
+// per block of 64 elements.
+constexpr size_t select_workspace_bytes(size_t n)
+{
+    auto const nblocks = (n + 63) / 64;
+    return nblocks * (sizeof(std::uint64_t) + sizeof(std::uint32_t));
+}
+
+// Select elements from "v" using "pred" and copy them to "w", as "select_mask" above, but using the
+// caller-provided "workspace" of at least "select_workspace_bytes(v.size())" bytes as scratch memory
+// instead of allocating. "w" must hold "v.size()" elements. Returns the number of selected elements.
+//
+// NOTE: neither "workspace" nor "w" needs to be initialized, and both can be reused across calls.
+template <class UnaryPredicate>
+size_t select_mask(std::span<const int> v, UnaryPredicate pred, std::span<std::byte> workspace,
+                   std::span<int> w)
+{
+    auto const n = v.size();
+    if (workspace.size() < select_workspace_bytes(n) || w.size() < n) {
+        std::cerr << "ERROR: select_mask needs " << select_workspace_bytes(n) << " bytes of workspace and "
+                  << n << " output elements, not " << workspace.size() << " and " << w.size() << std::endl;
+        std::terminate();
+    }
+    auto const nblocks = (n + 63) / 64;
+    // The mask words come first, which keeps them 8-byte aligned for an allocation aligned like "new".
+    auto mask = reinterpret_cast<std::uint64_t*>(workspace.data());
+    auto offsets = reinterpret_cast<std::uint32_t*>(mask + nblocks);
+
+    trace::range r("mask");
+    std::for_each_n(std::execution::par_unseq, std::views::iota(0).begin(), (int)nblocks,
+        [pred, n, v = v.data(), mask](int block) {
+            auto const b = (size_t)block * 64;
+            auto const e = std::min(n, b + 64);
+            std::uint64_t m = 0;
+            for (auto i = b; i < e; ++i) m |= std::uint64_t(pred(v[i]) ? 1 : 0) << (i - b);
+            mask[block] = m;
+    });
+    r.next("scan");
+    std::transform_exclusive_scan(std::execution::par, mask, mask + nblocks, offsets,
+                                  std::uint32_t(0), std::plus<std::uint32_t>{},
+                                  [](std::uint64_t m) { return (std::uint32_t)std::popcount(m); });
+    r.next("scatter");
+    std::for_each_n(std::execution::par_unseq, std::views::iota(0).begin(), (int)nblocks,
+        [v = v.data(), w = w.data(), mask, offsets](int block) {
+            auto o = offsets[block];
+            for (auto m = mask[block]; m != 0; m &= m - 1) {
+                w[o++] = v[(size_t)block * 64 + std::countr_zero(m)];
+            }
+    });
+    return nblocks == 0 ? 0 : offsets[nblocks - 1] + std::popcount(mask[nblocks - 1]);
+}
+
+// Stably partitions "v" into "k" buckets using "classifier", which must map each element to a
+// bucket in [0, k), writing the buckets one after the other to "w". Returns the k + 1 offsets of the
+// buckets in "w": bucket b spans [offsets[b], offsets[b + 1]).
+//
+// NOTE: "v" is read twice. The position of an element in "w" depends on the sizes of all preceding
+// buckets, i.e., on the classes of all elements, which are only known after a first pass over "v".
+// The classifier is evaluated once per element, and the second pass reads the stored bucket ids.
+// NOTE: each tile keeps the counters of its buckets in a local array, which limits "k" to 32.
+constexpr int max_buckets = 32;
+
+template <class Classifier>
+std::vector<size_t> partition_by(const std::vector<int>& v, Classifier classifier, int k,
+                                 std::vector<int>& w)
+{
+    if (k < 1 || k > max_buckets) {
+        std::cerr << "ERROR: partition_by supports 1 to " << max_buckets << " buckets, not " << k << std::endl;
+        std::terminate();
+    }
+    auto const n = v.size();
+    auto const ntiles = (n + tile_size - 1) / tile_size;
+    // The bucket of each element, and the number of elements of each bucket in each tile, stored
+    // bucket-major: their exclusive scan is the offset in "w" of each bucket of each tile.
+    std::vector<std::uint8_t> buckets(n);
+    std::vector<size_t> counts(k * ntiles), offsets(k * ntiles);
+
+    // Pass one: classify the elements of each tile and count the elements of each bucket:
+    trace::range r("classify");
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)ntiles,
+        [classifier, n, k, ntiles, v = v.data(), buckets = buckets.data(), counts = counts.data()](int tile) {
+            auto const b = (size_t)tile * tile_size;
+            auto const e = std::min(n, b + tile_size);
+            std::uint32_t local[max_buckets] = {};
+            for (auto i = b; i < e; ++i) {
+                auto const c = classifier(v[i]);
+                assert(c >= 0 && c < k && "classifier must return a bucket in [0, k)");
+                buckets[i] = c;
+                ++local[c];
+            }
+            for (int c = 0; c < k; ++c) counts[c * ntiles + tile] = local[c];
+    });
+    r.next("scan");
+    std::exclusive_scan(std::execution::par, counts.begin(), counts.end(), offsets.begin(), size_t(0));
+    std::vector<size_t> result(k + 1, n);
+    for (int c = 0; c < k; ++c) result[c] = ntiles == 0 ? 0 : offsets[c * ntiles];
+    w.resize(n);
+
+    // Pass two: copy the elements of each tile to the next position of their bucket:
+    r.next("scatter");
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)ntiles,
+        [n, k, ntiles, v = v.data(), w = w.data(), buckets = buckets.data(), offsets = offsets.data()](int tile) {
+            auto const b = (size_t)tile * tile_size;
+            auto const e = std::min(n, b + tile_size);
+            size_t local[max_buckets];
+            for (int c = 0; c < k; ++c) local[c] = offsets[c * ntiles + tile];
+            for (auto i = b; i < e; ++i) {
+                w[local[buckets[i]]++] = v[i];
+            }
+    });
+    return result;
+}
+
+// Stably partitions "v" into "w.size()" buckets using "classifier", as "partition_by" above, but
+// writes bucket b to "w[b]" in a single pass over "v", with the decoupled look-back of
+// "select_lookback": each tile publishes the counts of all its buckets, first as its aggregates and
+// then as the inclusive prefixes of its buckets and those of the preceding tiles. Each output must
+// hold "v.size()" elements, and need not be initialized. Returns the number of elements of each bucket.
+//
+// NOTE: the bucket ids of a tile are kept in a local array, such that the classifier is evaluated
+// once per element, and the elements are re-read from cache to copy them.
+template <class Classifier>
+std::vector<size_t> partition_lookback(std::span<const int> v, Classifier classifier,
+                                       std::span<const std::span<int>> w)
+{
+    auto const n = v.size();
+    auto const k = (int)w.size();
+    if (k < 1 || k > max_buckets) {
+        std::cerr << "ERROR: partition_lookback supports 1 to " << max_buckets << " buckets, not " << k << std::endl;
+        std::terminate();
+    }
+    std::vector<int*> outputs(k);
+    for (int c = 0; c < k; ++c) {
+        if (w[c].size() < n) {
+            std::cerr << "ERROR: partition_lookback needs " << n << " elements in output " << c << ", not "
+                      << w[c].size() << std::endl;
+            std::terminate();
+        }
+        outputs[c] = w[c].data();
+    }
+    auto const ntiles = (n + tile_size - 1) / tile_size;
+    // One status per tile, and the tile counter of "select_lookback". The k counts of a tile are
+    // written before its status is published, and only read after it has been observed:
+    std::vector<std::atomic<std::uint64_t>> status(ntiles + 1);
+    std::vector<size_t> aggregates(k * ntiles), prefixes(k * ntiles);
+    trace::range r("look-back");
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), (int)ntiles,
+        [classifier, n, k, ntiles, v = v.data(), outputs = outputs.data(), status = status.data(),
+         aggregates = aggregates.data(), prefixes = prefixes.data()](int) {
+            auto const tile = status[ntiles].fetch_add(1, std::memory_order_relaxed);
+            auto const b = tile * tile_size;
+            auto const e = std::min(n, b + tile_size);
+
+            // Classify the elements of the tile, count the elements of each bucket, and publish them:
+            std::uint8_t ids[tile_size];
+            size_t offset[max_buckets] = {};
+            for (auto i = b; i < e; ++i) {
+                auto const c = classifier(v[i]);
+                assert(c >= 0 && c < k && "classifier must return a bucket in [0, k)");
+                ids[i - b] = c;
+                ++offset[c];
+            }
+            auto const own = (tile == 0 ? prefixes : aggregates) + tile * k;
+            std::copy_n(offset, k, own);
+            status[tile].store(tile == 0 ? prefix : aggregate, std::memory_order_release);
+
+            // Look back at the preceding tiles, adding their counts up to the first inclusive prefix:
+            size_t preceding[max_buckets] = {};
+            for (auto j = tile; j-- > 0;) {
+                std::uint64_t s;
+                while ((s = status[j].load(std::memory_order_acquire)) == invalid);
+                auto const counts = (s == prefix ? prefixes : aggregates) + j * k;
+                for (int c = 0; c < k; ++c) preceding[c] += counts[c];
+                if (s == prefix) break;
+            }
+            if (tile > 0) {
+                for (int c = 0; c < k; ++c) prefixes[tile * k + c] = preceding[c] + offset[c];
+                status[tile].store(prefix, std::memory_order_release);
+            }
+
+            // Copy the elements of the tile to their final position in the output of their bucket:
+            for (auto i = b; i < e; ++i) {
+                auto const c = ids[i - b];
+                outputs[c][preceding[c]++] = v[i];
+            }
+    });
+    std::vector<size_t> result(k, 0);
+    if (ntiles > 0) std::copy_n(prefixes.begin() + (ntiles - 1) * k, k, result.begin());
+    return result;
+}
+
+// Initialize vector
+void initialize(std::vector<int>& v);
+
+// Checks that "w" holds the elements of "v" that "predicate" selects, in order
+template <typename Predicate>
+bool check(const std::vector<int>& v, Predicate&& predicate, const std::vector<int>& w);
+
+// Benchmarks the implementation, and returns its bandwidth in [GB/s]
+template <typename Select, typename Predicate>
+double bench(const char* name, Select&& select, std::vector<int>& v, Predicate&& predicate,
+           std::vector<size_t>& index, std::vector<int>& w);
+
+// Checks and benchmarks partitioning "v" into the classes of "x % 3" against one "select" per class
+void bench_partition(std::vector<int>& v, std::vector<size_t>& index, std::vector<int>& w);
+
+// Benchmarks the allocation-free "mask" select on first-touched NUMA-aware copies of "v", its workspace and its output
+template <typename Predicate>
+void bench_numa(std::vector<int>& v, Predicate&& predicate, std::vector<size_t>& index, std::vector<int>& w);
+
+int main(int argc, char* argv[])
+{
+    // Read CLI arguments, the first argument is the name of the binary:
+    if (argc != 2) {
+        std::cerr << "ERROR: Missing length argument!" << std::endl;
+        return 1;
+    }
+
+    // Read length of vector elements
+    long long n = std::stoll(argv[1]);
+
+    // Pin the threads before they touch any memory, if PIN_THREADS=1:
+    numa::pin_threads();
+
+    // Allocate the data vector
+    auto v = std::vector<int>(n);
+
+    initialize(v);
+
+    auto predicate = [](int x) { return x % 3 == 0; };
+    std::vector<size_t> index;
+    std::vector<int> w;
+
+    auto copy_if = [](auto&&... args) { select_copy_if(args...); };
+    auto scan = [](auto&&... args) { select_scan(args...); };
+    auto mask = [](auto&&... args) { select_mask(args...); };
+
+    // The workspace and output of "look-back" and of the allocation-free "mask" are sized once, and
+    // left uninitialized:
+    auto workspace_bytes = select_workspace_bytes(v.size());
+    auto workspace = std::make_unique_for_overwrite<std::byte[]>(workspace_bytes);
+    auto output = std::make_unique_for_overwrite<int[]>(v.size());
+    size_t count = 0;
+    auto lookback = [&](auto& v, auto pred, auto&, auto&) {
+        count = select_lookback(std::span<const int>(v), pred, std::span(output.get(), v.size()));
+    };
+    auto mask_workspace = [&](auto& v, auto pred, auto&, auto&) {
+        count = select_mask(std::span<const int>(v), pred, std::span(workspace.get(), workspace_bytes),
+                            std::span(output.get(), v.size()));
+    };
+    lookback(v, predicate, index, w);
+    bool ok = check(v, predicate, std::vector<int>(output.get(), output.get() + count));
+    mask(v, predicate, index, w);
+    ok = ok && check(v, predicate, w);
+    mask_workspace(v, predicate, index, w);
+    if (!ok || !check(v, predicate, std::vector<int>(output.get(), output.get() + count))) {
+        std::cerr << "ERROR! ";
+        std::cout << "w[0.." << std::min(10, (int)w.size()) << "] = ";
+        std::copy(w.begin(), w.begin() + std::min(10, (int)w.size()), std::ostream_iterator<int>(std::cout, " "));
+        std::cout << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cerr << "Check: OK" << std::endl;
+
+    bench("copy_if", copy_if, v, predicate, index, w);
+    bench("scan+scatter", scan, v, predicate, index, w);
+    bench("look-back", lookback, v, predicate, index, w);
+    bench("mask", mask, v, predicate, index, w);
+    bench("mask with workspace", mask_workspace, v, predicate, index, w);
+
+    bench_partition(v, index, w);
+    bench_numa(v, predicate, index, w);
+
+    return EXIT_SUCCESS;
+}
+
+void initialize(std::vector<int>& v)
+{
+    auto distribution = std::uniform_int_distribution<int> {0, 100};
+    auto engine = std::mt19937 {1};
+    std::generate(v.begin(), v.end(), [&distribution, &engine]{ return distribution(engine); });
+}
+
+template <typename Predicate>
+bool check(const std::vector<int>& v, Predicate&& predicate, const std::vector<int>& w)
+{
+    std::vector<int> expected;
+    std::copy_if(v.begin(), v.end(), std::back_inserter(expected), predicate);
+    return !w.empty() && w == expected;
+}
+
+template <typename Select, typename Predicate>
+double bench(const char* name, Select&& select, std::vector<int>& v, Predicate&& predicate,
+             std::vector<size_t>& index, std::vector<int>& w) {
+    // Measure bandwidth in [GB/s], for the bytes of a memcpy of "v":
+    auto bytes = 2. * sizeof(int) * (double)v.size();
+    auto r = benchmark::run(name, {bytes, 0.}, [&] { select(v, predicate, index, w); }, {.warmup = 1, .reps = 10});
+    std::cerr << name << ": Problem size: " << bytes * 1.e-9 << " GB" << std::endl;
+    benchmark::report(r);
+    return r.gbs();
+}
+
+void bench_partition(std::vector<int>& v, std::vector<size_t>& index, std::vector<int>& w) {
+    int const k = 3;
+    auto classifier = [](int x) { return x % 3; };
+    auto offsets = partition_by(v, classifier, k, w);
+    for (int c = 0; c < k; ++c) {
+        std::vector<int> expected;
+        std::copy_if(v.begin(), v.end(), std::back_inserter(expected), [c](int x) { return x % 3 == c; });
+        if (!std::equal(w.begin() + offsets[c], w.begin() + offsets[c + 1], expected.begin(), expected.end())) {
+            std::cerr << "ERROR! bucket " << c << " of partition_by differs" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        std::cerr << "Bucket " << c << ": " << offsets[c + 1] - offsets[c] << " elements" << std::endl;
+    }
+
+    // The outputs of "partition_lookback" are sized once, and left uninitialized:
+    std::unique_ptr<int[]> outputs[k];
+    std::span<int> buckets[k];
+    for (int c = 0; c < k; ++c) {
+        outputs[c] = std::make_unique_for_overwrite<int[]>(v.size());
+        buckets[c] = std::span(outputs[c].get(), v.size());
+    }
+    auto sizes = partition_lookback(std::span<const int>(v), classifier, std::span<const std::span<int>>(buckets));
+    for (int c = 0; c < k; ++c) {
+        if (sizes[c] != offsets[c + 1] - offsets[c]
+            || !std::equal(buckets[c].begin(), buckets[c].begin() + sizes[c], w.begin() + offsets[c])) {
+            std::cerr << "ERROR! bucket " << c << " of partition_lookback differs" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // Measure bandwidth in [GB/s]
+    auto bytes = 2. * sizeof(int) * (double)v.size();
+    benchmark::report(benchmark::run("partition_by (k = 3)", {bytes, 0.}, [&] { partition_by(v, classifier, k, w); }));
+    benchmark::report(benchmark::run("partition look-back (k = 3)", {bytes, 0.}, [&] {
+        partition_lookback(std::span<const int>(v), classifier, std::span<const std::span<int>>(buckets));
+    }));
+    std::vector<int> bucket;
+    benchmark::report(benchmark::run("mask select per bucket (k = 3)", {bytes, 0.}, [&] {
+        for (int c = 0; c < k; ++c) {
+            select_mask(v, [c](int x) { return x % 3 == c; }, index, bucket);
+        }
+    }));
+}
+
+template <typename Predicate>
+void bench_numa(std::vector<int>& v, Predicate&& predicate, std::vector<size_t>& index, std::vector<int>& w) {
+    // The parallel "copy" and "first_touch" place the pages of the copies:
+    numa::vector<int> u(v.size()), output(v.size());
+    numa::vector<std::byte> workspace(select_workspace_bytes(v.size()));
+    std::copy(std::execution::par, v.begin(), v.end(), u.begin());
+    numa::first_touch(std::span(output));
+    numa::first_touch(std::span(workspace));
+    auto mask_numa = [&](auto&, auto pred, auto&, auto&) {
+        select_mask(std::span<const int>(u), pred, std::span(workspace), std::span(output));
+    };
+    bench("mask with workspace, NUMA first touch", mask_numa, v, predicate, index, w);
+    numa::report("mask with workspace",
+                 {std::as_bytes(std::span(u)), std::as_bytes(std::span(output))});
+}
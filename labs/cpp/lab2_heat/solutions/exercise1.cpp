@@ -34,6 +34,8 @@
 #include <numeric>
 #include <ranges>
 #include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
 
 using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
 
@@ -125,17 +127,22 @@ int main(int argc, char *argv[]) {
   using clk_t = std::chrono::steady_clock;
   auto start = clk_t::now();
 
+  benchmark::result steps{"heat solutions/exercise1", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
   for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
     // Evolve the solution:
     double energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
 
     // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
     MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
                MPI_COMM_WORLD);
     if (p.rank == 0 && it % p.nout() == 0) {
       std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
     }
     std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
   }
 
   auto time = std::chrono::duration<double>(clk_t::now() - start).count();
@@ -146,9 +153,11 @@ int main(int argc, char *argv[]) {
               << memory_bw << " GB/s" << std::endl;
     std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
               << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
   }
 
   // Write output to file
+  trace::range output("output");
   MPI_File f;
   MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
   auto header_bytes = 2 * sizeof(long) + sizeof(double);
@@ -177,6 +186,7 @@ int main(int argc, char *argv[]) {
   MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
   MPI_File_close(&f);
 
+  output.next("MPI_Finalize");
   MPI_Finalize();
   return 0;
 }
@@ -213,6 +223,7 @@ double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
 // Evolve the solution of the interior part of the domain
 // which does not depend on data from neighboring ranks
 double inner(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("inner");
   grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
   return apply_stencil(u_new, u_old, g, p);
 }
@@ -220,6 +231,7 @@ double inner(grid_t u_new, grid_t u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the previous MPI rank (rank - 1)
 double prev(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("prev");
   thread_local std::vector<double> halos_tx((std::size_t)p.ny);
   thread_local std::vector<double> halos_rx((std::size_t)p.ny);
   // Send window cells, receive halo cells
@@ -245,6 +257,7 @@ double prev(grid_t u_new, grid_t u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the next MPI rank (rank + 1)
 double next(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("next");
   // Allocate data for transmitting and receiving halos:
   thread_local std::vector<double> halos_tx((std::size_t)p.ny);
   thread_local std::vector<double> halos_rx((std::size_t)p.ny);
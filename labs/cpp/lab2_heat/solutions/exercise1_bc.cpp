@@ -0,0 +1,285 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 in which the boundary conditions are not imposed by `stencil` for every
+//! cell. Instead, a separate pass fills the ghost layers once per time step according to a
+//! boundary condition policy chosen at compile time for each axis, and the stencil is applied to
+//! the owned cells by a branch-free kernel that the compiler can vectorize.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Boundary condition policies.
+//
+// `lo` and `hi` return the values of the ghost cells before the first and after the last cell of
+// an axis, given the values of the `first` and `last` cells of the axis.
+
+// Fixed value at the boundary
+struct dirichlet {
+  double lo_value = 0., hi_value = 0.;
+  static constexpr bool wraps = false;
+  double lo(double, double) const { return lo_value; }
+  double hi(double, double) const { return hi_value; }
+};
+
+// Zero flux through the boundary
+struct neumann {
+  static constexpr bool wraps = false;
+  double lo(double first, double) const { return first; }
+  double hi(double, double last) const { return last; }
+};
+
+// The axis wraps around
+struct periodic {
+  static constexpr bool wraps = true;
+  double lo(double, double last) const { return last; }
+  double hi(double first, double) const { return first; }
+};
+
+// Boundary conditions along the x (distributed across MPI ranks) and y axes.
+template <class XBC, class YBC>
+struct boundary_conditions {
+  XBC x;
+  YBC y;
+};
+
+// The original problem: the domain is heated at the beginning of the x axis.
+// Replace the policies to solve a different problem, e.g, boundary_conditions<periodic, neumann>{}.
+using bc_t = boundary_conditions<dirichlet, dirichlet>;
+constexpr bc_t bc{.x = {.lo_value = 1., .hi_value = 0.}, .y = {.lo_value = 0., .hi_value = 0.}};
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+
+  // Ranks of the neighbors, or -1 if there is none:
+  // with periodic boundaries along x, the first and last ranks are neighbors.
+  bool x_periodic() { return bc_t{}.x.wraps && nranks > 1; }
+  int prev_rank() { return rank > 0 ? rank - 1 : x_periodic() ? nranks - 1 : -1; }
+  int next_rank() { return rank < nranks - 1 ? rank + 1 : x_periodic() ? 0 : -1; }
+};
+
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, parameters p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(
+    std::execution::par, ids.begin(), ids.end(), 0., std::plus{},
+    [u_new, u_old, p](auto idx) {
+      auto [x, y] = idx;
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Fills the ghost layers of `u` that are not exchanged with other ranks.
+template <class XBC, class YBC>
+void apply_boundary_conditions(grid_t u, boundary_conditions<XBC, YBC> bc, parameters p) {
+  // Ghost cells y == 0 and y == ny - 1 of the rows owned by this rank:
+  std::for_each_n(std::execution::par, std::views::iota(1).begin(), p.nx, [u, bc, p](int x) {
+    double first = u(x, 1), last = u(x, p.ny - 2);
+    u(x, 0) = bc.y.lo(first, last);
+    u(x, p.ny - 1) = bc.y.hi(first, last);
+  });
+  // Ghost rows x == 0 of the first and x == nx + 1 of the last rank, unless they are exchanged:
+  bool lo = p.prev_rank() == -1, hi = p.next_rank() == -1;
+  if (!lo && !hi) return;
+  bool local = p.nranks == 1; // Both the first and the last row are owned by this rank
+  std::for_each_n(std::execution::par, std::views::iota(1).begin(), p.ny - 2,
+                  [u, bc, p, lo, hi, local](int y) {
+    double first = u(1, y), last = u(p.nx, y);
+    if (lo) u(0, y) = bc.x.lo(first, local ? last : first);
+    if (hi) u(p.nx + 1, y) = bc.x.hi(local ? first : last, last);
+  });
+}
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+}
+
+// Exchanges the halo rows with the previous (rank - 1) and next (rank + 1) MPI ranks.
+void exchange(grid_t u_old, parameters p);
+
+// Evolve the solution of the cells owned by this rank; requires that all ghost layers are filled.
+double evolve(grid_t u_new, grid_t u_old, parameters p) {
+  grid g{.x_begin = 1, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx+2, p.ny};
+  grid_t u_old{u_old_data.data(), p.nx+2, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_bc", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Fill the ghost layers once, then evolve the solution:
+    exchange(u_old, p);
+    apply_boundary_conditions(u_old, bc, p);
+    double energy = evolve(u_new, u_old, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  // The ghost layers of the last solution have not been filled yet:
+  apply_boundary_conditions(u_old, bc, p);
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, u_old.data_handle() + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil: only reads the neighbors, does not impose boundary conditions.
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
+  u_new(x, y) = (1. - 4. * p.gamma()) * u_old(x, y) + p.gamma() * (u_old(x+1, y) + u_old(x-1, y) +
+                                                                   u_old(x, y+1) + u_old(x, y-1));
+  return u_new(x, y) * p.dx * p.dx;
+}
+
+void exchange(grid_t u_old, parameters p) {
+  // Post all receives and sends before waiting on any of them, such that neither the ranks nor
+  // a periodic ring of ranks serialize against each other:
+  MPI_Request req[4] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  if (int prev = p.prev_rank(); prev != -1) {
+    MPI_Irecv(&u_old(0, 0), p.ny, MPI_DOUBLE, prev, 1, MPI_COMM_WORLD, &req[0]);
+    MPI_Isend(&u_old(1, 0), p.ny, MPI_DOUBLE, prev, 0, MPI_COMM_WORLD, &req[1]);
+  }
+  if (int next = p.next_rank(); next != -1) {
+    MPI_Irecv(&u_old(p.nx + 1, 0), p.ny, MPI_DOUBLE, next, 0, MPI_COMM_WORLD, &req[2]);
+    MPI_Isend(&u_old(p.nx, 0), p.ny, MPI_DOUBLE, next, 1, MPI_COMM_WORLD, &req[3]);
+  }
+  MPI_Waitall(4, req, MPI_STATUSES_IGNORE);
+}
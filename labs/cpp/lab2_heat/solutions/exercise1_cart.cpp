@@ -0,0 +1,274 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 that decomposes the domain over a 2D process grid created with
+//! MPI_Cart_create. Every rank owns a block of the global domain and exchanges halos with up to
+//! four neighbors, which reduces the halo volume per rank from O(ny) to O(nx/px + ny/py).
+//! The global domain sizes are read from the command line and need not divide evenly.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx_g, ny_g, ni;  // Global domain size and number of iterations
+  long nx, ny, x0, y0;  // Local domain size and offset in the global domain
+  int rank = 0, nranks = 1;
+  int dims[2] = {0, 0}, coords[2] = {0, 0};
+  // Neighboring ranks along x and y, or MPI_PROC_NULL at the end of the domain:
+  int x_prev, x_next, y_prev, y_next;
+  MPI_Comm comm = MPI_COMM_WORLD;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+  // Creates the 2D process grid and computes the local domain of this rank
+  void decompose();
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx_g; }
+  long ny_global() { return ny_g; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return (nx + 2) * (ny + 2) /* 2 halo layers per dimension */; }
+};
+
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, parameters p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(
+    std::execution::par, ids.begin(), ids.end(), 0., std::plus{},
+    [u_new, u_old, p](auto idx) {
+      auto [x, y] = idx;
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old, parameters p) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+  // The boundary condition at the beginning of the x axis is held by the halo layer of the ranks
+  // without a previous neighbor, which is never overwritten by a halo exchange:
+  if (p.x_prev == MPI_PROC_NULL) {
+    std::fill_n(std::execution::par, u_old.data_handle(), p.ny + 2, 1.0);
+    std::fill_n(std::execution::par, u_new.data_handle(), p.ny + 2, 1.0);
+  }
+}
+
+// Exchanges the halos with the up to four neighbors of this rank.
+void exchange(grid_t u_old, parameters p);
+
+// Evolve the solution of the local domain.
+double evolve(grid_t u_new, grid_t u_old, parameters p) {
+  // Cells at the beginning and end of the global y axis hold the boundary conditions:
+  grid g{.x_begin = 1, .x_end = p.nx + 1,
+         .y_begin = p.y0 == 0 ? 2 : 1, .y_end = p.y0 + p.ny == p.ny_g ? p.ny : p.ny + 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  p.decompose();
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx+2, p.ny+2};
+  grid_t u_old{u_old_data.data(), p.nx+2, p.ny+2};
+
+  // Initial condition
+  initial_condition(u_new, u_old, p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_cart", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Exchange halos and evolve the solution:
+    exchange(u_old, p);
+    double energy = evolve(u_new, u_old, p);
+
+    // Reduce the energy across all ranks to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0, p.comm);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  auto global_size = static_cast<double>(p.nx_g * p.ny_g * sizeof(double) * 2) * 1e-9; // GB
+  auto global_bw = global_size * static_cast<double>(p.nit()) / time;                 // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB, "
+              << 2 * (p.nx + p.ny) << " halo cells): " << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << global_size << " GB) on "
+              << p.dims[0] << "x" << p.dims[1] << " ranks: " << global_bw << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  // Write output to file: the header is followed by the global domain in row-major order, and
+  // every rank writes its block into it through a subarray file view.
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(p.comm, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  MPI_File_set_size(f, header_bytes + p.nx_g * p.ny_g * sizeof(double));
+  if (p.rank == 0) {
+    long total[2] = {p.nx_g, p.ny_g};
+    double time = p.nit() * p.dt;
+    MPI_File_write_at(f, 0, total, 2, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_write_at(f, 2 * sizeof(long), &time, 1, MPI_DOUBLE, MPI_STATUS_IGNORE);
+  }
+  MPI_Datatype file_block, local_block;
+  int file_sizes[2] = {(int)p.nx_g, (int)p.ny_g}, sizes[2] = {(int)p.nx + 2, (int)p.ny + 2};
+  int subsizes[2] = {(int)p.nx, (int)p.ny}, file_starts[2] = {(int)p.x0, (int)p.y0}, starts[2] = {1, 1};
+  MPI_Type_create_subarray(2, file_sizes, subsizes, file_starts, MPI_ORDER_C, MPI_DOUBLE, &file_block);
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &local_block);
+  MPI_Type_commit(&file_block);
+  MPI_Type_commit(&local_block);
+  MPI_File_set_view(f, header_bytes, MPI_DOUBLE, file_block, "native", MPI_INFO_NULL);
+  MPI_File_write_all(f, u_old.data_handle(), 1, local_block, MPI_STATUS_IGNORE);
+  MPI_Type_free(&file_block);
+  MPI_Type_free(&local_block);
+  MPI_File_close(&f);
+
+  MPI_Comm_free(&p.comm);
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx global> <ny global> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx_g = std::stoll(argv[1]);
+  ny_g = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx_g;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Splits `n` cells over `parts` ranks: the first `n % parts` ranks get one more cell.
+// Returns the size and offset of the block of the `part`-th rank.
+std::pair<long, long> block(long n, int parts, int part) {
+  long size = n / parts, rem = n % parts;
+  return {size + (part < rem ? 1 : 0), part * size + std::min<long>(part, rem)};
+}
+
+void parameters::decompose() {
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  MPI_Dims_create(nranks, 2, dims);
+  int periods[2] = {0, 0};
+  MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, /* reorder = */ 1, &comm);
+  MPI_Comm_rank(comm, &rank);
+  MPI_Cart_coords(comm, rank, 2, coords);
+  MPI_Cart_shift(comm, 0, 1, &x_prev, &x_next);
+  MPI_Cart_shift(comm, 1, 1, &y_prev, &y_next);
+  if (nx_g < dims[0] || ny_g < 2 * dims[1]) {
+    std::cerr << "ERROR: global domain " << nx_g << "x" << ny_g << " too small for "
+              << dims[0] << "x" << dims[1] << " ranks" << std::endl;
+    std::terminate();
+  }
+  std::tie(nx, x0) = block(nx_g, dims[0], coords[0]);
+  std::tie(ny, y0) = block(ny_g, dims[1], coords[1]);
+}
+
+// Finite-difference stencil
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
+  u_new(x, y) = (1. - 4. * p.gamma()) * u_old(x, y) + p.gamma() * (u_old(x+1, y) + u_old(x-1, y) +
+                                                                   u_old(x, y+1) + u_old(x, y-1));
+  return u_new(x, y) * p.dx * p.dx;
+}
+
+void exchange(grid_t u_old, parameters p) {
+  // Rows are contiguous in memory and are sent and received in place
+  // (send to one neighbor and receive from the opposite one, to avoid serializing the ranks):
+  MPI_Sendrecv(&u_old(1, 1), p.ny, MPI_DOUBLE, p.x_prev, 0,
+               &u_old(p.nx + 1, 1), p.ny, MPI_DOUBLE, p.x_next, 0, p.comm, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(&u_old(p.nx, 1), p.ny, MPI_DOUBLE, p.x_next, 1,
+               &u_old(0, 1), p.ny, MPI_DOUBLE, p.x_prev, 1, p.comm, MPI_STATUS_IGNORE);
+
+  // Columns are strided: pack them into contiguous buffers in parallel
+  thread_local std::vector<double> halos_tx(2 * p.nx), halos_rx(2 * p.nx);
+  auto tx = halos_tx.data(), rx = halos_rx.data();
+  std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.nx, [tx, u_old, p](int i) {
+    tx[i] = u_old(i + 1, 1);
+    tx[p.nx + i] = u_old(i + 1, p.ny);
+  });
+  MPI_Sendrecv(tx, p.nx, MPI_DOUBLE, p.y_prev, 2,
+               rx + p.nx, p.nx, MPI_DOUBLE, p.y_next, 2, p.comm, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(tx + p.nx, p.nx, MPI_DOUBLE, p.y_next, 3,
+               rx, p.nx, MPI_DOUBLE, p.y_prev, 3, p.comm, MPI_STATUS_IGNORE);
+  // Unpack the columns of the neighbors that exist:
+  bool has_prev = p.y_prev != MPI_PROC_NULL, has_next = p.y_next != MPI_PROC_NULL;
+  std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.nx,
+                  [rx, u_old, p, has_prev, has_next](int i) {
+    if (has_prev) u_old(i + 1, 0) = rx[i];
+    if (has_next) u_old(i + 1, p.ny + 1) = rx[p.nx + i];
+  });
+}
@@ -0,0 +1,385 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 that writes a snapshot of the solution every `nsnap` time steps into the
+//! "snapshots" time-series file without stalling the time loop: the solution is copied into one of
+//! two staging buffers (pinned host memory in the GPU build), and a collective MPI-IO write of it
+//! proceeds in the background while the following time steps are computed.
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+#if defined(_NVHPC_STDPAR_GPU)
+#include <cuda_runtime.h>
+#endif
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni, ns = 1000;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nsnap() { return ns; } // Time steps between snapshots
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+};
+
+// Time series of snapshots written asynchronously to the file "snapshots".
+//
+// File layout: uint64 {nx_global, ny}, followed by one frame per snapshot consisting of a uint64
+// time step index, the double time, and the nx_global * ny values (see `visualize_series` in vis.py).
+//
+// `write` fills one staging buffer while the collective write of the other one may still be in
+// flight, then completes that write before starting its own: at most one write is outstanding.
+struct snapshots {
+  struct frame_header {
+    std::uint64_t step;
+    double time;
+  };
+
+  std::array<double *, 2> staging;
+  std::array<frame_header, 2> headers;
+  // Values of this rank, and the frame header written by rank 0:
+  std::array<MPI_Request, 2> req{MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  MPI_File f;
+  long nframes = 0;
+  int current = 0;
+  double seconds = 0.; // Time spent by the time loop in `write`
+  parameters p;
+
+  snapshots(parameters p);
+  void write(grid_t u, long step);
+  // Completes the outstanding write and closes the file; must be called before MPI_Finalize.
+  void close();
+
+  MPI_Offset frame_bytes() { return sizeof(frame_header) + p.nx_global() * p.ny * sizeof(double); }
+};
+
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, parameters p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(
+    std::execution::par, ids.begin(), ids.end(), 0., std::plus{}, [u_new, u_old, p](auto idx) {
+      auto [x, y] = idx;
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+}
+
+// These evolve the solution of different parts of the local domain.
+double inner(grid_t u_new, grid_t u_old, parameters p);
+double prev (grid_t u_new, grid_t u_old, parameters p);
+double next (grid_t u_new, grid_t u_old, parameters p);
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx+2, p.ny};
+  grid_t u_old{u_old_data.data(), p.nx+2, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old);
+
+  snapshots snaps(p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_checkpoint", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Evolve the solution:
+    double energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+
+    // Snapshot the solution at time (it + 1) * dt:
+    if ((it + 1) % p.nsnap() == 0) snaps.write(u_old, it + 1);
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    std::cerr << "Snapshots: " << snaps.nframes << " frames, " << snaps.seconds << " s of " << time
+              << " s spent in the time loop" << std::endl;
+    benchmark::report(steps);
+  }
+  snaps.close();
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  auto u_out_data = std::vector<double>(p.n());
+  using grid_io_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+  grid_io_t u_out{u_out_data.data(), p.nx+2, p.ny};
+  auto is = std::views::iota(0, (int)u_out.extent(0));
+  auto js = std::views::iota(0, (int)u_out.extent(1));
+  auto ids = std::views::cartesian_product(is, js);
+  std::for_each(std::execution::par, ids.begin(), ids.end(), [u_out, u_old](auto idx) {
+     auto [i, j] = idx;
+     u_out(i, j) = u_old(i, j);
+  });
+  MPI_File_iwrite_at(f, values_offset, u_out.data_handle() + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4 && argc != 5) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni> [<nsnap>]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  if (argc == 5) ns = std::stoll(argv[4]);
+  if (ns < 1) {
+    std::cerr << "ERROR: nsnap must be positive" << std::endl;
+    std::terminate();
+  }
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
+  if (y == 1) u_old(x, y-1) = 0;
+  if (y == (p.ny - 2)) u_old(x, y+1) = 0;
+
+  // These boundary conditions are only imposed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) u_old(x-1, y) = 1;
+  if (p.rank == (p.nranks - 1) && x == p.nx) u_old(x+1, y) = 0;
+
+  u_new(x, y) = (1. - 4. * p.gamma()) * u_old(x, y) + p.gamma() * (u_old(x+1, y) + u_old(x-1, y) +
+                                                                   u_old(x, y+1) + u_old(x, y-1));
+
+  return u_new(x, y) * p.dx * p.dx;
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+double inner(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("inner");
+  grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the previous MPI rank (rank - 1)
+double prev(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("prev");
+  thread_local std::vector<double> halos_tx((std::size_t)p.ny);
+  thread_local std::vector<double> halos_rx((std::size_t)p.ny);
+  // Send window cells, receive halo cells
+  if (p.rank > 0) {
+    // Copy halos to transmit into the transmit buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_tx = halos_tx.data(), u_old](int i) {
+       halos_tx[i] = u_old(1, i); 
+    });
+    // Send bottom boundary to bottom rank and receive top boundary from bottom rank
+    MPI_Sendrecv(halos_tx.data(), p.ny, MPI_DOUBLE, p.rank - 1, 0, 
+                 halos_rx.data(), p.ny, MPI_DOUBLE, p.rank - 1, 0, 
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy data from the receive buffer into the grid
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_rx = halos_rx.data(), u_old](int i) {
+       u_old(0, i) = halos_rx[i]; 
+    });
+  }
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the next MPI rank (rank + 1)
+double next(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("next");
+  // Allocate data for transmitting and receiving halos:
+  thread_local std::vector<double> halos_tx((std::size_t)p.ny);
+  thread_local std::vector<double> halos_rx((std::size_t)p.ny);
+    
+  if (p.rank < p.nranks - 1) {
+    // Copy halos to transmit into the transmit buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_tx = halos_tx.data(), u_old, p](int i) {
+      halos_tx[i] = u_old(p.nx, i); 
+    });
+    // Receive bottom boundary from top rank and send top boundary to top rank
+    MPI_Sendrecv(halos_tx.data(), p.ny, MPI_DOUBLE, p.rank + 1, 0, 
+                 halos_rx.data(), p.ny, MPI_DOUBLE, p.rank + 1, 0, 
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy received halos to the u_old solution buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_rx = halos_rx.data(), u_old, p](int i) {
+      u_old(p.nx+1, i) = halos_rx[i]; 
+    });
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Allocates the staging buffers of the snapshots: page-locked in the GPU build, such that the
+// device can write them directly and MPI-IO reads them without another host copy.
+double *allocate_staging(std::size_t n) {
+#if defined(_NVHPC_STDPAR_GPU)
+  void *ptr = nullptr;
+  if (cudaMallocHost(&ptr, n * sizeof(double)) != cudaSuccess) {
+    std::cerr << "ERROR: failed to allocate " << n * sizeof(double) << " B of pinned memory" << std::endl;
+    std::terminate();
+  }
+  return static_cast<double *>(ptr);
+#else
+  return new double[n];
+#endif
+}
+
+void free_staging(double *ptr) {
+#if defined(_NVHPC_STDPAR_GPU)
+  cudaFreeHost(ptr);
+#else
+  delete[] ptr;
+#endif
+}
+
+snapshots::snapshots(parameters p) : p(p) {
+  for (auto &s : staging) s = allocate_staging(p.nx * p.ny);
+  MPI_File_open(MPI_COMM_WORLD, "snapshots", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  MPI_File_set_size(f, 0); // Truncate the frames of previous runs
+  if (p.rank == 0) {
+    std::uint64_t total[2] = {(std::uint64_t)p.nx_global(), (std::uint64_t)p.ny};
+    MPI_File_write_at(f, 0, total, 2, MPI_UINT64_T, MPI_STATUS_IGNORE);
+  }
+}
+
+void snapshots::write(grid_t u, long step) {
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  // NOTE: the buffer being filled is not the one of the write that may still be in flight.
+  auto values_per_rank = p.nx * p.ny;
+  std::copy_n(std::execution::par, u.data_handle() + p.ny, values_per_rank, staging[current]);
+  headers[current] = {.step = (std::uint64_t)step, .time = step * p.dt};
+
+  MPI_Waitall(req.size(), req.data(), MPI_STATUSES_IGNORE);
+
+  auto frame_offset = 2 * sizeof(std::uint64_t) + nframes * frame_bytes();
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, frame_offset, &headers[current], sizeof(frame_header), MPI_BYTE, &req[1]);
+  }
+  auto values_offset = frame_offset + sizeof(frame_header) + p.rank * values_per_rank * sizeof(double);
+  MPI_File_iwrite_at_all(f, values_offset, staging[current], values_per_rank, MPI_DOUBLE, &req[0]);
+
+  ++nframes;
+  current = 1 - current;
+  seconds += std::chrono::duration<double>(clk_t::now() - start).count();
+}
+
+void snapshots::close() {
+  MPI_Waitall(req.size(), req.data(), MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+  for (auto s : staging) free_staging(s);
+}
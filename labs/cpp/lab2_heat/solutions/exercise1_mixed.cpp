@@ -0,0 +1,349 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 with a templated storage type for the solution: the fields are stored as
+//! `float` (`__nv_bfloat16` in the GPU build), halving the memory traffic of this bandwidth-bound
+//! solver, while the stencil is evaluated and the energy accumulated in `double`. The problem is
+//! solved twice, in `double` and in the storage type, and the error of the latter is reported.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <type_traits>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+#if defined(_NVHPC_STDPAR_GPU)
+#include <cuda_bf16.h>
+using storage_t = __nv_bfloat16;
+#else
+using storage_t = float;
+#endif
+
+template <class T>
+using grid_t = std::mdspan<T, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Conversions between the storage type and the type in which the stencil is evaluated
+template <class T>
+double to_double(T v) {
+  if constexpr (std::is_floating_point_v<T>) return static_cast<double>(v);
+  else return static_cast<double>(static_cast<float>(v));
+}
+template <class T>
+T from_double(double v) {
+  if constexpr (std::is_floating_point_v<T>) return static_cast<T>(v);
+  else return static_cast<T>(static_cast<float>(v));
+}
+
+// MPI datatype of the storage type; bf16 has none, but it is only moved, never reduced, by MPI
+template <class T>
+MPI_Datatype mpi_datatype() {
+  if constexpr (std::is_same_v<T, double>) return MPI_DOUBLE;
+  else if constexpr (std::is_same_v<T, float>) return MPI_FLOAT;
+  else {
+    static_assert(sizeof(T) == sizeof(std::uint16_t));
+    return MPI_UINT16_T;
+  }
+}
+
+// Problem parameters
+template <class T>
+struct parameters {
+  using value_type = T; // Storage type of the solution
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+  // Same problem, different storage type:
+  template <class U>
+  parameters(parameters<U> const& o) : dx(o.dx), dt(o.dt), nx(o.nx), ny(o.ny), ni(o.ni), rank(o.rank), nranks(o.nranks) {}
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+};
+
+template <class T>
+double stencil(grid_t<T> u_new, grid_t<T> u_old, long x, long y, parameters<T> p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+template <class T>
+double apply_stencil(grid_t<T> u_new, grid_t<T> u_old, grid g, parameters<T> p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(
+    std::execution::par, ids.begin(), ids.end(), 0., std::plus{}, [u_new, u_old, p](auto idx) {
+      auto [x, y] = idx;
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Initial condition
+template <class T>
+void initial_condition(grid_t<T> u_new, grid_t<T> u_old) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), from_double<T>(0.0));
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), from_double<T>(0.0));
+}
+
+// These evolve the solution of different parts of the local domain.
+template <class T> double inner(grid_t<T> u_new, grid_t<T> u_old, parameters<T> p);
+template <class T> double prev (grid_t<T> u_new, grid_t<T> u_old, parameters<T> p);
+template <class T> double next (grid_t<T> u_new, grid_t<T> u_old, parameters<T> p);
+
+// Solution of the local domain (without halos) converted to double, and the final energy.
+struct result {
+  std::vector<double> u;
+  double energy, seconds;
+};
+
+// Runs the time loop with the solution stored as T
+template <class T>
+result solve(parameters<T> p, bool verbose) {
+  // Allocate memory
+  std::vector<T> u_new_data(p.n()), u_old_data(p.n());
+  grid_t<T> u_new{u_new_data.data(), p.nx+2, p.ny};
+  grid_t<T> u_old{u_old_data.data(), p.nx+2, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  double energy = 0.;
+  benchmark::result steps{"heat solutions/exercise1_mixed", {2. * p.nx * p.ny * sizeof(T), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Evolve the solution:
+    energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (verbose && p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(T) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;        // GB/s
+  if (verbose && p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  result r{.u = std::vector<double>(p.nx * p.ny), .energy = energy, .seconds = time};
+  std::transform(std::execution::par, u_old.data_handle() + p.ny, u_old.data_handle() + (p.nx + 1) * p.ny,
+                 r.u.begin(), [](T v) { return to_double(v); });
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters<double> p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Reference solution in double, then the mixed-precision one:
+  auto ref = solve(p, false);
+  auto sol = solve(parameters<storage_t>(p), true);
+
+  // Error of the mixed-precision solution against the reference on the same grid:
+  auto ids = std::views::iota(0L, (long)sol.u.size());
+  double errors[3] = { // max |u - u_ref|, sum (u - u_ref)^2, sum u_ref^2
+    std::transform_reduce(std::execution::par, ids.begin(), ids.end(), 0.,
+                          [](double a, double b) { return std::max(a, b); },
+                          [u = sol.u.data(), v = ref.u.data()](long i) { return std::abs(u[i] - v[i]); }),
+    std::transform_reduce(std::execution::par, sol.u.begin(), sol.u.end(), ref.u.begin(), 0., std::plus{},
+                          [](double a, double b) { return (a - b) * (a - b); }),
+    std::transform_reduce(std::execution::par, ref.u.begin(), ref.u.end(), ref.u.begin(), 0.)
+  };
+  MPI_Allreduce(MPI_IN_PLACE, &errors[0], 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &errors[1], 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  if (p.rank == 0) {
+    std::cerr << "Error of " << sizeof(storage_t) << "-byte storage vs. double at t = " << p.nit() * p.dt
+              << ": max = " << errors[0] << ", relative L2 = " << std::sqrt(errors[1] / errors[2])
+              << ", energy = " << std::abs(sol.energy - ref.energy) / ref.energy << " (relative)" << std::endl;
+    std::cerr << "Speedup vs. double: " << ref.seconds / sol.seconds << "x" << std::endl;
+  }
+
+  // Write output to file; in double, such that vis.py can read it
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, sol.u.data(), values_per_rank, mpi_datatype<double>(), &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+template <class T>
+parameters<T>::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil: evaluated in double, the result is rounded to the storage type
+template <class T>
+double stencil(grid_t<T> u_new, grid_t<T> u_old, long x, long y, parameters<T> p) {
+  if (y == 1) u_old(x, y-1) = from_double<T>(0);
+  if (y == (p.ny - 2)) u_old(x, y+1) = from_double<T>(0);
+
+  // These boundary conditions are only imposed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) u_old(x-1, y) = from_double<T>(1);
+  if (p.rank == (p.nranks - 1) && x == p.nx) u_old(x+1, y) = from_double<T>(0);
+
+  auto u = [u_old](long x, long y) { return to_double(u_old(x, y)); };
+  u_new(x, y) = from_double<T>((1. - 4. * p.gamma()) * u(x, y) + p.gamma() * (u(x+1, y) + u(x-1, y) +
+                                                                               u(x, y+1) + u(x, y-1)));
+
+  return to_double(u_new(x, y)) * p.dx * p.dx;
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+template <class T>
+double inner(grid_t<T> u_new, grid_t<T> u_old, parameters<T> p) {
+  trace::range r("inner");
+  grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the previous MPI rank (rank - 1)
+template <class T>
+double prev(grid_t<T> u_new, grid_t<T> u_old, parameters<T> p) {
+  trace::range r("prev");
+  thread_local std::vector<T> halos_tx((std::size_t)p.ny);
+  thread_local std::vector<T> halos_rx((std::size_t)p.ny);
+  // Send window cells, receive halo cells
+  if (p.rank > 0) {
+    // Copy halos to transmit into the transmit buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_tx = halos_tx.data(), u_old](int i) {
+       halos_tx[i] = u_old(1, i);
+    });
+    // Send bottom boundary to bottom rank and receive top boundary from bottom rank
+    MPI_Sendrecv(halos_tx.data(), p.ny, mpi_datatype<T>(), p.rank - 1, 0,
+                 halos_rx.data(), p.ny, mpi_datatype<T>(), p.rank - 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy data from the receive buffer into the grid
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_rx = halos_rx.data(), u_old](int i) {
+       u_old(0, i) = halos_rx[i];
+    });
+  }
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the next MPI rank (rank + 1)
+template <class T>
+double next(grid_t<T> u_new, grid_t<T> u_old, parameters<T> p) {
+  trace::range r("next");
+  // Allocate data for transmitting and receiving halos:
+  thread_local std::vector<T> halos_tx((std::size_t)p.ny);
+  thread_local std::vector<T> halos_rx((std::size_t)p.ny);
+
+  if (p.rank < p.nranks - 1) {
+    // Copy halos to transmit into the transmit buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_tx = halos_tx.data(), u_old, p](int i) {
+      halos_tx[i] = u_old(p.nx, i);
+    });
+    // Receive bottom boundary from top rank and send top boundary to top rank
+    MPI_Sendrecv(halos_tx.data(), p.ny, mpi_datatype<T>(), p.rank + 1, 0,
+                 halos_rx.data(), p.ny, mpi_datatype<T>(), p.rank + 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy received halos to the u_old solution buffer
+    std::for_each_n(std::execution::par, std::views::iota(0).begin(), p.ny, [halos_rx = halos_rx.data(), u_old, p](int i) {
+      u_old(p.nx+1, i) = halos_rx[i];
+    });
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
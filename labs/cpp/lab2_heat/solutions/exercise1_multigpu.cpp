@@ -0,0 +1,378 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Multi-GPU variant of exercise1, with device-resident grids and halos. With `-stdpar=gpu`,
+//! exercise1 allocates the grids in managed memory and passes them to MPI, which accesses them
+//! from the host and migrates their pages on every time step. Instead, this variant:
+//!
+//! - binds each rank to one GPU of its node, from its rank among the ranks of the node,
+//! - allocates the grids with `cudaMalloc`, such that they never leave device memory,
+//! - sends and receives the halo rows, which are contiguous rows of the grids that need no
+//!   packing, straight from and to device memory with CUDA-aware MPI.
+//!
+//! If the MPI library is not CUDA-aware, which Open MPI reports with `MPIX_Query_cuda_support`
+//! and other libraries can be told with `CUDA_AWARE_MPI=0|1`, the halos are staged through
+//! pinned host buffers instead. The CPU build runs the same code on host memory, and ignores
+//! `CUDA_AWARE_MPI`.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <string_view>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+#if defined(_NVHPC_STDPAR_GPU)
+#include <cuda_runtime.h>
+#if __has_include(<mpi-ext.h>)
+#include <mpi-ext.h> // Open MPI: MPIX_Query_cuda_support
+#endif
+#endif
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+  bool cuda_aware = true; // Whether MPI can access the device memory of the grids
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+};
+
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, parameters p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(std::execution::par, ids.begin(), ids.end(), 0., std::plus{},
+                               [u_new, u_old, p](auto idx) {
+                                 auto [x, y] = idx;
+                                 return stencil(u_new, u_old, x, y, p);
+                               });
+}
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+}
+
+// These evolve the solution of different parts of the local domain.
+double inner(grid_t u_new, grid_t u_old, parameters p);
+double prev (grid_t u_new, grid_t u_old, parameters p);
+double next (grid_t u_new, grid_t u_old, parameters p);
+
+// Returns the rank of this process among the ranks of its node from the environment of the
+// launcher, which is available before MPI_Init, or -1 if the launcher is unknown.
+int local_rank_from_env() {
+  for (auto v : {"OMPI_COMM_WORLD_LOCAL_RANK", "MV2_COMM_WORLD_LOCAL_RANK", "MPI_LOCALRANKID",
+                 "PMI_LOCAL_RANK", "SLURM_LOCALID"}) {
+    if (auto e = std::getenv(v)) return std::stoi(e);
+  }
+  return -1;
+}
+
+// Returns the rank of this process among the ranks of its node from MPI
+int local_rank_from_mpi() {
+  MPI_Comm local;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &local);
+  int r;
+  MPI_Comm_rank(local, &r);
+  MPI_Comm_free(&local);
+  return r;
+}
+
+// Binds this process to GPU `local_rank` modulo the number of GPUs of the node, and returns it.
+int bind_gpu(int local_rank) {
+#if defined(_NVHPC_STDPAR_GPU)
+  int count = 0;
+  if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0) {
+    std::cerr << "ERROR: no GPU found" << std::endl;
+    std::terminate();
+  }
+  int device = local_rank % count;
+  if (cudaSetDevice(device) != cudaSuccess) {
+    std::cerr << "ERROR: failed to bind local rank " << local_rank << " to GPU " << device << std::endl;
+    std::terminate();
+  }
+  return device;
+#else
+  (void)local_rank;
+  return -1;
+#endif
+}
+
+// Returns whether MPI can send and receive device memory
+bool cuda_aware_mpi() {
+#if !defined(_NVHPC_STDPAR_GPU)
+  return true; // The grids are in host memory
+#else
+  if (auto e = std::getenv("CUDA_AWARE_MPI")) return std::string_view(e) == "1";
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+  return MPIX_Query_cuda_support() == 1;
+#else
+  return false;
+#endif
+#endif
+}
+
+// Allocates `n` values in device memory in the GPU build, and in host memory otherwise.
+double *allocate_device(std::size_t n) {
+#if defined(_NVHPC_STDPAR_GPU)
+  void *ptr = nullptr;
+  if (cudaMalloc(&ptr, n * sizeof(double)) != cudaSuccess) {
+    std::cerr << "ERROR: failed to allocate " << n * sizeof(double) << " B of device memory" << std::endl;
+    std::terminate();
+  }
+  return static_cast<double *>(ptr);
+#else
+  return new double[n];
+#endif
+}
+
+void free_device(double *ptr) {
+#if defined(_NVHPC_STDPAR_GPU)
+  cudaFree(ptr);
+#else
+  delete[] ptr;
+#endif
+}
+
+// Copies `n` values from device memory to host memory
+void copy_to_host(double const *device, double *host, std::size_t n) {
+#if defined(_NVHPC_STDPAR_GPU)
+  cudaMemcpy(host, device, n * sizeof(double), cudaMemcpyDeviceToHost);
+#else
+  std::copy_n(device, n, host);
+#endif
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Bind to a GPU before MPI_Init if the launcher tells the local rank, such that a CUDA-aware MPI
+  // initializes on that GPU; otherwise bind after MPI_Init, before any device allocation.
+  int local_rank = local_rank_from_env();
+  // The device is only reported by the GPU build:
+  [[maybe_unused]] int device = local_rank >= 0 ? bind_gpu(local_rank) : -1;
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+  if (local_rank < 0) {
+    local_rank = local_rank_from_mpi();
+    device = bind_gpu(local_rank);
+  }
+  p.cuda_aware = cuda_aware_mpi();
+#if defined(_NVHPC_STDPAR_GPU)
+  std::cerr << "Rank " << p.rank << ": local rank " << local_rank << " on GPU " << device
+            << (p.cuda_aware ? ", CUDA-aware MPI" : ", halos staged through host memory") << std::endl;
+#endif
+
+  // Allocate memory
+  double *u_new_data = allocate_device(p.n()), *u_old_data = allocate_device(p.n());
+  grid_t u_new{u_new_data, p.nx+2, p.ny};
+  grid_t u_old{u_old_data, p.nx+2, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_multigpu", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Evolve the solution:
+    double energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  // Write output to file: the owned rows are copied from the device once, after the time loop
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  std::vector<double> u_out(values_per_rank);
+  copy_to_host(u_old.data_handle() + p.ny, u_out.data(), values_per_rank);
+  MPI_File_iwrite_at(f, values_offset, u_out.data(), values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  free_device(u_new_data);
+  free_device(u_old_data);
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
+  if (y == 1) u_old(x, y-1) = 0;
+  if (y == (p.ny - 2)) u_old(x, y+1) = 0;
+
+  // These boundary conditions are only imposed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) u_old(x-1, y) = 1;
+  if (p.rank == (p.nranks - 1) && x == p.nx) u_old(x+1, y) = 0;
+
+  u_new(x, y) = (1. - 4. * p.gamma()) * u_old(x, y) + p.gamma() * (u_old(x+1, y) + u_old(x-1, y) +
+                                                                   u_old(x, y+1) + u_old(x, y-1));
+
+  return u_new(x, y) * p.dx * p.dx;
+}
+
+// Sends the `p.ny` values of the row `tx` to rank `neighbor`, and receives its row into `rx`. Both
+// rows are in device memory in the GPU build: CUDA-aware MPI transfers them directly, and other
+// MPI libraries from pinned host buffers, which live as long as the process.
+void exchange(double const *tx, double *rx, int neighbor, parameters p) {
+  if (p.cuda_aware) {
+    MPI_Sendrecv(tx, p.ny, MPI_DOUBLE, neighbor, 0, rx, p.ny, MPI_DOUBLE, neighbor, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    return;
+  }
+#if defined(_NVHPC_STDPAR_GPU)
+  thread_local double *host_tx = nullptr, *host_rx = nullptr;
+  if (host_tx == nullptr && (cudaMallocHost(&host_tx, p.ny * sizeof(double)) != cudaSuccess ||
+                             cudaMallocHost(&host_rx, p.ny * sizeof(double)) != cudaSuccess)) {
+    std::cerr << "ERROR: failed to allocate " << 2 * p.ny * sizeof(double) << " B of pinned memory" << std::endl;
+    std::terminate();
+  }
+  cudaMemcpy(host_tx, tx, p.ny * sizeof(double), cudaMemcpyDeviceToHost);
+  MPI_Sendrecv(host_tx, p.ny, MPI_DOUBLE, neighbor, 0, host_rx, p.ny, MPI_DOUBLE, neighbor, 0,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  cudaMemcpy(rx, host_rx, p.ny * sizeof(double), cudaMemcpyHostToDevice);
+#endif
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+double inner(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("inner");
+  grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the previous MPI rank (rank - 1)
+double prev(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("prev");
+  // Send the first owned row to the previous rank, and receive its last one into the halo row 0:
+  if (p.rank > 0) exchange(u_old.data_handle() + p.ny, u_old.data_handle(), p.rank - 1, p);
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the next MPI rank (rank + 1)
+double next(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("next");
+  // Send the last owned row to the next rank, and receive its first one into the halo row nx + 1:
+  if (p.rank < p.nranks - 1) {
+    exchange(u_old.data_handle() + p.nx * p.ny, u_old.data_handle() + (p.nx + 1) * p.ny, p.rank + 1, p);
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
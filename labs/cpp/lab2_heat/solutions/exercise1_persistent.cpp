@@ -0,0 +1,330 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 in which the halos are exchanged with persistent, non-blocking MPI requests.
+//! The exchange for a time step is posted before `inner` starts, and the requests of each neighbor
+//! are only completed right before the boundary row that depends on them is computed.
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+};
+
+// Persistent halo exchange with the previous (rank - 1) and next (rank + 1) MPI ranks.
+//
+// The solution buffers are swapped every time step, so one set of requests is created for each of
+// them. `start` posts all sends and receives of `u_old` at once, such that neighboring ranks never
+// serialize against each other, and `wait_prev`/`wait_next` complete the requests of one neighbor.
+struct halo_exchange {
+  std::array<double *, 2> buffers;
+  // For each buffer: send and receive with the previous rank, followed by those of the next rank.
+  std::array<std::array<MPI_Request, 4>, 2> requests;
+  parameters p;
+
+  halo_exchange(double *u_new, double *u_old, parameters p);
+  void start(double *u_old);
+  void wait_prev(double *u_old);
+  void wait_next(double *u_old);
+  // Frees the requests; must be called before MPI_Finalize.
+  void free();
+
+  std::array<MPI_Request, 4> &of(double *u_old) {
+    assert(u_old == buffers[0] || u_old == buffers[1]);
+    return requests[u_old == buffers[0] ? 0 : 1];
+  }
+};
+
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p);
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, parameters p) {
+  // DONE Create one iota range per dimension for [g.x_begin,g.x_end) and [g.y_begin,g.y_end).
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  // DONE: Construct a cartesian_product range from the two iota ranges: [g.x_begin,g.x_end)x[g.y_begin,g.y_end).
+  auto ids = std::views::cartesian_product(xs, ys);
+  // DONE: Use the std::transform_reduce algorithm to apply the stencil in parallel to each element and sum the energies:
+  return std::transform_reduce(
+    // DONE: Use the std::execution::par parallel execution policy
+    std::execution::par,
+    // DONE: iterate over the cartesian_product range
+    ids.begin(), ids.end(),
+    // DONE: initialize the energy to zero
+    0.,
+    // DONE: use std::plus to sum the energies
+    std::plus{},
+    // DONE: Use a lambda that applies the stencil to one element and returns its energy:
+    [u_new, u_old, p](auto idx) {
+      // DONE [within lambda]: Extract the 1D indices from the tuple of indices:
+      auto [x, y] = idx;
+      // DONE [within lambda]: Apply the stencil and return the energy.
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old) {
+  // DONE: parallelize using the std::fill_n parallel algorithm
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+}
+
+// These evolve the solution of different parts of the local domain.
+double inner(grid_t u_new, grid_t u_old, parameters p);
+double prev (grid_t u_new, grid_t u_old, parameters p, halo_exchange& halos);
+double next (grid_t u_new, grid_t u_old, parameters p, halo_exchange& halos);
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx+2, p.ny};
+  grid_t u_old{u_old_data.data(), p.nx+2, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old);
+
+  // Create the persistent requests once for both buffers
+  halo_exchange halos(u_new.data_handle(), u_old.data_handle(), p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_persistent", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Post the halo exchange, and evolve the interior while it is in flight:
+    halos.start(u_old.data_handle());
+    double energy = inner(u_new, u_old, p);
+    // Complete the exchange with each neighbor before evolving the boundary that depends on it:
+    energy += prev(u_new, u_old, p, halos) + next(u_new, u_old, p, halos);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): " 
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  halos.free();
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  auto u_out_data = std::vector<double>(p.n());
+  using grid_io_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+  grid_io_t u_out{u_out_data.data(), p.nx+2, p.ny};
+  auto is = std::views::iota(0, (int)u_out.extent(0));
+  auto js = std::views::iota(0, (int)u_out.extent(1));
+  auto ids = std::views::cartesian_product(is, js);
+  std::for_each(std::execution::par, ids.begin(), ids.end(), [u_out, u_old](auto idx) {
+     auto [i, j] = idx;
+     u_out(i, j) = u_old(i, j);
+  });
+  MPI_File_iwrite_at(f, values_offset, u_out.data_handle() + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil
+double stencil(grid_t u_new, grid_t u_old, long x, long y, parameters p) {
+  if (y == 1) u_old(x, y-1) = 0;
+  if (y == (p.ny - 2)) u_old(x, y+1) = 0;
+
+  // These boundary conditions are only imposed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) u_old(x-1, y) = 1;
+  if (p.rank == (p.nranks - 1) && x == p.nx) u_old(x+1, y) = 0;
+
+  u_new(x, y) = (1. - 4. * p.gamma()) * u_old(x, y) + p.gamma() * (u_old(x+1, y) + u_old(x-1, y) +
+                                                                   u_old(x, y+1) + u_old(x, y-1));
+
+  return u_new(x, y) * p.dx * p.dx;
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+double inner(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("inner");
+  grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the previous MPI rank (rank - 1)
+double prev(grid_t u_new, grid_t u_old, parameters p, halo_exchange &halos) {
+  trace::range r("prev");
+  // Complete the exchange of the halo cells with the bottom rank
+  halos.wait_prev(u_old.data_handle());
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the next MPI rank (rank + 1)
+double next(grid_t u_new, grid_t u_old, parameters p, halo_exchange &halos) {
+  trace::range r("next");
+  // Complete the exchange of the halo cells with the top rank
+  halos.wait_next(u_old.data_handle());
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+halo_exchange::halo_exchange(double *u_new, double *u_old, parameters p)
+    : buffers{u_new, u_old}, p(p) {
+  for (std::size_t b = 0; b < buffers.size(); ++b) {
+    auto u = buffers[b];
+    auto &r = requests[b];
+    r.fill(MPI_REQUEST_NULL);
+    if (p.rank > 0) {
+      // Send bottom boundary to bottom rank, receive top boundary from bottom rank
+      MPI_Send_init(u + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0, MPI_COMM_WORLD, &r[0]);
+      MPI_Recv_init(u + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1, MPI_COMM_WORLD, &r[1]);
+    }
+    if (p.rank < p.nranks - 1) {
+      // Send top boundary to top rank, receive bottom boundary from top rank
+      MPI_Send_init(u + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1, MPI_COMM_WORLD, &r[2]);
+      MPI_Recv_init(u + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD, &r[3]);
+    }
+  }
+}
+
+void halo_exchange::start(double *u_old) {
+  auto &r = of(u_old);
+  if (p.rank > 0) MPI_Startall(2, &r[0]);
+  if (p.rank < p.nranks - 1) MPI_Startall(2, &r[2]);
+}
+
+void halo_exchange::wait_prev(double *u_old) {
+  MPI_Waitall(2, &of(u_old)[0], MPI_STATUSES_IGNORE);
+}
+
+void halo_exchange::wait_next(double *u_old) {
+  MPI_Waitall(2, &of(u_old)[2], MPI_STATUSES_IGNORE);
+}
+
+void halo_exchange::free() {
+  for (auto &r : requests) {
+    for (auto &req : r) {
+      if (req != MPI_REQUEST_NULL) MPI_Request_free(&req);
+    }
+  }
+}
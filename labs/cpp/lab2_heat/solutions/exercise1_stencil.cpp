@@ -0,0 +1,377 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise1 whose stencil is a template parameter: each stencil type provides its
+//! radius and weights as `constexpr` members, from which `stencil<S>` computes its coefficients
+//! at compile time, unrolls its loads, and `parameters<S>` derives the number of halo layers and
+//! a stable time step. The boundary conditions are imposed once, on the halos of the initial
+//! condition, instead of in every call of the stencil.
+//!
+//! As in exercise1, the columns y = 0 and y = ny - 1 are the cold boundary of the domain. A stencil
+//! of radius r reads r - 1 more columns beyond them, so the local grid has r - 1 ghost columns per
+//! side, which hold the boundary value, and every stencil updates the same columns [1, ny - 1).
+//!
+//! Usage: heat <nx> <ny> <ni> [5-point|9-point|radius-2|radius-3]
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Discrete Laplacians times dx^2: `axis[r]` is the weight of the 4 neighbors at distance r > 0
+// along the axes, `2 * axis[0]` the weight of the center, and `corner` the weight of the
+// 4 diagonal neighbors.
+
+// Second order, 5 points
+struct five_point {
+  static constexpr std::string_view name = "5-point";
+  static constexpr long radius = 1;
+  static constexpr std::array<double, radius + 1> axis{-2., 1.};
+  static constexpr double corner = 0.;
+};
+
+// Second order, 9 points, with isotropic truncation error
+struct nine_point {
+  static constexpr std::string_view name = "9-point";
+  static constexpr long radius = 1;
+  static constexpr std::array<double, radius + 1> axis{-10. / 6., 4. / 6.};
+  static constexpr double corner = 1. / 6.;
+};
+
+// Fourth order, 9 points
+struct radius_2 {
+  static constexpr std::string_view name = "radius-2";
+  static constexpr long radius = 2;
+  static constexpr std::array<double, radius + 1> axis{-5. / 2., 4. / 3., -1. / 12.};
+  static constexpr double corner = 0.;
+};
+
+// Sixth order, 13 points
+struct radius_3 {
+  static constexpr std::string_view name = "radius-3";
+  static constexpr long radius = 3;
+  static constexpr std::array<double, radius + 1> axis{-49. / 18., 3. / 2., -3. / 20., 1. / 90.};
+  static constexpr double corner = 0.;
+};
+
+// Bound of the magnitude of the eigenvalues of the Laplacian of `S`, from Gershgorin's theorem
+template <class S>
+constexpr double max_eigenvalue() {
+  constexpr auto abs = [](double w) { return w < 0. ? -w : w; };
+  double sum = abs(2. * S::axis[0]) + 4. * abs(S::corner);
+  for (long r = 1; r <= S::radius; ++r) sum += 4. * abs(S::axis[r]);
+  return sum;
+}
+
+// Explicit Euler is stable for gamma * max_eigenvalue <= 2: use 80% of that, which is the
+// gamma = 1/5 of exercise1 for the 5-point stencil.
+template <class S>
+constexpr double stable_gamma() {
+  return 1.6 / max_eigenvalue<S>();
+}
+static_assert(stable_gamma<five_point>() == 0.2);
+
+// Problem parameters
+template <class S>
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+  static constexpr long halo() { return S::radius; } // Halo layers per side
+  static constexpr long ghosts() { return S::radius - 1; } // Ghost columns per side
+  static constexpr double gamma() { return stable_gamma<S>(); }
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  long ncols() { return ny + 2 * ghosts(); } // Columns of the local grid
+  long n() { return ncols() * (nx + 2 * halo()); }
+};
+
+// Finite-difference stencil: coefficients and offsets are compile-time constants
+template <class S>
+double stencil(grid_t u_new, grid_t u_old, long x, long y) {
+  constexpr double center = 1. + stable_gamma<S>() * 2. * S::axis[0];
+  constexpr double corner = stable_gamma<S>() * S::corner;
+  double u = center * u_old(x, y);
+  [&]<long... R>(std::integer_sequence<long, R...>) {
+    ((u += stable_gamma<S>() * S::axis[R + 1] *
+           (u_old(x + R + 1, y) + u_old(x - R - 1, y) + u_old(x, y + R + 1) + u_old(x, y - R - 1))),
+     ...);
+  }(std::make_integer_sequence<long, S::radius>{});
+  if constexpr (corner != 0.) {
+    u += corner * (u_old(x + 1, y + 1) + u_old(x + 1, y - 1) + u_old(x - 1, y + 1) + u_old(x - 1, y - 1));
+  }
+  u_new(x, y) = u;
+  return u;
+}
+
+// Floating-point operations of `stencil<S>` and of the reduction of its energy
+template <class S>
+constexpr double flops() {
+  return 2. + 5. * S::radius + (S::corner != 0. ? 5. : 0.) + 2.;
+}
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+template <class S>
+double apply_stencil(grid_t u_new, grid_t u_old, grid g, double dx) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  // Only the grids and the cell area are captured, not the parameters:
+  return std::transform_reduce(std::execution::par, ids.begin(), ids.end(), 0., std::plus{},
+                               [u_new, u_old, area = dx * dx](auto idx) {
+                                 auto [x, y] = idx;
+                                 return stencil<S>(u_new, u_old, x, y) * area;
+                               });
+}
+
+// Initial condition: zero, with the boundary conditions on the halos that are not exchanged
+template <class S>
+void initial_condition(grid_t u_new, grid_t u_old, parameters<S> p) {
+  for (grid_t u : {u_new, u_old}) {
+    std::fill_n(std::execution::par, u.data_handle(), u.size(), 0.0);
+    // The halo of the first rank is the hot boundary of the domain; as in exercise1, its corners
+    // with the cold boundary columns, which the 9-point stencil reads, stay 0:
+    if (p.rank == 0) {
+      for (long x = 0; x < p.halo(); ++x) {
+        std::fill_n(std::execution::par, &u(x, p.halo()), p.ny - 2, 1.0);
+      }
+    }
+  }
+}
+
+// These evolve the solution of different parts of the local domain.
+template <class S> double inner(grid_t u_new, grid_t u_old, parameters<S> p);
+template <class S> double prev(grid_t u_new, grid_t u_old, parameters<S> p);
+template <class S> double next(grid_t u_new, grid_t u_old, parameters<S> p);
+
+// Solves the problem with the stencil `S`
+template <class S>
+void solve(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters<S> p(argc, argv);
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+  if (p.nx < 2 * p.halo() || p.ny < 3) {
+    std::cerr << "ERROR: the " << S::name << " stencil needs nx >= " << 2 * p.halo() << " and ny >= 3"
+              << std::endl;
+    std::terminate();
+  }
+
+  // Allocate memory
+  long const h = p.halo();
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx + 2 * h, p.ncols()};
+  grid_t u_old{u_old_data.data(), p.nx + 2 * h, p.ncols()};
+
+  // Initial condition
+  initial_condition(u_new, u_old, p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  benchmark::result steps{"heat solutions/exercise1_stencil " + std::string(S::name),
+                          {2. * p.nx * p.ny * sizeof(double), flops<S>() * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    trace::range r("evolve");
+    // Evolve the solution:
+    double energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << S::name << " stencil, " << h << " halo layers: Rank " << p.rank << ": local domain "
+              << p.nx << "x" << p.ny << " (" << grid_size << " GB): " << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " ("
+              << (grid_size * p.nranks) << " GB): " << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  // The owned rows without their ghost columns are written from the grid without a copy:
+  MPI_Datatype local_block;
+  int sizes[2] = {(int)(p.nx + 2 * h), (int)p.ncols()}, subsizes[2] = {(int)p.nx, (int)p.ny};
+  int starts[2] = {(int)h, (int)p.ghosts()};
+  MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &local_block);
+  MPI_Type_commit(&local_block);
+  MPI_File_iwrite_at(f, values_offset, u_old.data_handle(), 1, local_block, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_Type_free(&local_block);
+  MPI_File_close(&f);
+}
+
+int main(int argc, char *argv[]) {
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+
+  // Select the stencil, which is a compile-time parameter of the solver:
+  std::string_view shape = argc > 4 ? argv[4] : five_point::name;
+  if (shape == five_point::name) solve<five_point>(argc, argv);
+  else if (shape == nine_point::name) solve<nine_point>(argc, argv);
+  else if (shape == radius_2::name) solve<radius_2>(argc, argv);
+  else if (shape == radius_3::name) solve<radius_3>(argc, argv);
+  else {
+    std::cerr << "ERROR: unknown stencil " << shape << ", expected one of " << five_point::name << ", "
+              << nine_point::name << ", " << radius_2::name << ", " << radius_3::name << std::endl;
+    std::terminate();
+  }
+
+  trace::range r("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+template <class S>
+parameters<S>::parameters(int argc, char *argv[]) {
+  if (argc != 4 && argc != 5) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni> [" << five_point::name << "|" << nine_point::name
+              << "|" << radius_2::name << "|" << radius_3::name << "]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = gamma() * dx * dx / alpha();
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+template <class S>
+double inner(grid_t u_new, grid_t u_old, parameters<S> p) {
+  trace::range r("inner");
+  long const h = p.halo();
+  grid g{.x_begin = 2 * h, .x_end = p.nx, .y_begin = h, .y_end = p.ny + h - 2};
+  return apply_stencil<S>(u_new, u_old, g, p.dx);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the previous MPI rank (rank - 1)
+template <class S>
+double prev(grid_t u_new, grid_t u_old, parameters<S> p) {
+  trace::range r("prev");
+  long const h = p.halo();
+  thread_local std::vector<double> halos_tx((std::size_t)(h * p.ncols()));
+  thread_local std::vector<double> halos_rx((std::size_t)(h * p.ncols()));
+  // Send the first `h` owned rows, receive the `h` halo rows
+  if (p.rank > 0) {
+    // Copy halos to transmit into the transmit buffer
+    std::copy_n(std::execution::par, u_old.data_handle() + h * p.ncols(), h * p.ncols(), halos_tx.begin());
+    // Send bottom boundary to bottom rank and receive top boundary from bottom rank
+    MPI_Sendrecv(halos_tx.data(), h * p.ncols(), MPI_DOUBLE, p.rank - 1, 0,
+                 halos_rx.data(), h * p.ncols(), MPI_DOUBLE, p.rank - 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy data from the receive buffer into the grid
+    std::copy_n(std::execution::par, halos_rx.begin(), h * p.ncols(), u_old.data_handle());
+  }
+  // Compute prev boundary
+  grid g{.x_begin = h, .x_end = 2 * h, .y_begin = h, .y_end = p.ny + h - 2};
+  return apply_stencil<S>(u_new, u_old, g, p.dx);
+}
+
+// Evolve the solution of the part of the domain that
+// depends on data from the next MPI rank (rank + 1)
+template <class S>
+double next(grid_t u_new, grid_t u_old, parameters<S> p) {
+  trace::range r("next");
+  long const h = p.halo();
+  // Allocate data for transmitting and receiving halos:
+  thread_local std::vector<double> halos_tx((std::size_t)(h * p.ncols()));
+  thread_local std::vector<double> halos_rx((std::size_t)(h * p.ncols()));
+
+  if (p.rank < p.nranks - 1) {
+    // Copy halos to transmit into the transmit buffer
+    std::copy_n(std::execution::par, u_old.data_handle() + p.nx * p.ncols(), h * p.ncols(), halos_tx.begin());
+    // Receive bottom boundary from top rank and send top boundary to top rank
+    MPI_Sendrecv(halos_tx.data(), h * p.ncols(), MPI_DOUBLE, p.rank + 1, 0,
+                 halos_rx.data(), h * p.ncols(), MPI_DOUBLE, p.rank + 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy received halos to the u_old solution buffer
+    std::copy_n(std::execution::par, halos_rx.begin(), h * p.ncols(), u_old.data_handle() + (p.nx + h) * p.ncols());
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + h, .y_begin = h, .y_end = p.ny + h - 2};
+  return apply_stencil<S>(u_new, u_old, g, p.dx);
+}
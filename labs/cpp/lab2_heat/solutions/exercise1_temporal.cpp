@@ -0,0 +1,372 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Temporally blocked variant of exercise1: the local domain carries `k` halo layers per side,
+//! halos are exchanged once every `k` time steps, and each sweep advances `k` time steps over
+//! cache-sized tiles before writing the result back to memory.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <bench.hpp>
+#include <trace.hpp>
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  long k = 4; // Time steps per sweep == number of halo layers per side
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+  // Tile shape: two (tile_x + 2k) x (tile_y + 2k) scratch buffers should fit in the L2 cache.
+  static constexpr long tile_x() { return 64; }
+  static constexpr long tile_y() { return 512; }
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 * k /* 2k halo layers */); }
+  long ntiles_x() { return (nx + tile_x() - 1) / tile_x(); }
+  long ntiles_y() { return (ny - 2 + tile_y() - 1) / tile_y(); }
+  long ntiles() { return ntiles_x() * ntiles_y(); }
+};
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+// Returns the tile `t` of the owned part of the domain: rows [k, nx + k), columns [1, ny - 1).
+grid tile(long t, parameters p) {
+  long tx = t / p.ntiles_y(), ty = t % p.ntiles_y();
+  long x_begin = p.k + tx * p.tile_x(), y_begin = 1 + ty * p.tile_y();
+  return {.x_begin = x_begin,
+          .x_end = std::min(x_begin + p.tile_x(), p.nx + p.k),
+          .y_begin = y_begin,
+          .y_end = std::min(y_begin + p.tile_y(), p.ny - 1)};
+}
+
+// Returns the tile `g` extended by the `k` cells that `k` time steps of the stencil depend on.
+grid extended(grid g, parameters p) {
+  return {.x_begin = g.x_begin - p.k,
+          .x_end = g.x_end + p.k,
+          .y_begin = std::max(g.y_begin - p.k, 0L),
+          .y_end = std::min(g.y_end + p.k, p.ny)};
+}
+
+// Returns the cells of the extended tile of `g` that time step `s` of a sweep updates: each time step
+// shrinks the valid region by one cell per side, and cells that hold boundary conditions are never
+// updated.
+grid updated(grid g, long s, parameters p) {
+  // Rows outside of [x_lo, x_hi) hold the boundary conditions of the ranks at the end of the domain:
+  long x_lo = p.rank == 0 ? p.k : 0;
+  long x_hi = p.rank == p.nranks - 1 ? p.nx + p.k : p.nx + 2 * p.k;
+  return {.x_begin = std::max(g.x_begin - p.k + s, x_lo),
+          .x_end = std::min(g.x_end + p.k - s, x_hi),
+          .y_begin = std::max(g.y_begin - p.k + s, 1L),
+          .y_end = std::min(g.y_end + p.k - s, p.ny - 1)};
+}
+
+#if defined(_NVHPC_STDPAR_GPU)
+// Advances the solution by `steps <= k` time steps and returns the energy of the last one.
+//
+// Device threads can neither run a tile serially fast enough nor fork nested parallel loops, so
+// every phase of the sweep is one parallel loop over the cells of all tiles, and every tile keeps
+// its own scratch buffers in place of thread_local storage. The halos are still exchanged once
+// per sweep, but the scratch buffers do not stay in cache across time steps.
+double sweep(grid_t u_new, grid_t u_old, long steps, parameters p) {
+  assert(steps <= p.k);
+  long const cells = (p.tile_x() + 2 * p.k) * (p.tile_y() + 2 * p.k); // Of one extended tile
+  static std::vector<double> scratch(2 * cells * p.ntiles());
+  double *s = scratch.data();
+  double c0 = 1. - 4. * p.gamma(), c1 = p.gamma();
+
+  // Both buffers of tile t start as a copy of its extended tile, in row-major order:
+  auto ids = std::views::iota(0L, p.ntiles() * cells);
+  std::for_each(std::execution::par, ids.begin(), ids.end(), [=](long i) {
+    long t = i / cells, c = i % cells;
+    auto e = extended(tile(t, p), p);
+    long ey = e.y_end - e.y_begin, x = c / ey, y = c % ey;
+    if (x >= e.x_end - e.x_begin) return;
+    double *a = s + 2 * cells * t;
+    a[c] = a[cells + c] = u_old(e.x_begin + x, e.y_begin + y);
+  });
+
+  // Time step `step` reads buffer `(step - 1) % 2` and writes the other one:
+  for (long step = 1; step <= steps; ++step) {
+    long in = (step - 1) % 2;
+    std::for_each(std::execution::par, ids.begin(), ids.end(), [=](long i) {
+      long t = i / cells, c = i % cells;
+      auto g = tile(t, p);
+      auto e = extended(g, p), v = updated(g, step, p);
+      long ey = e.y_end - e.y_begin, x = e.x_begin + c / ey, y = e.y_begin + c % ey;
+      if (x < v.x_begin || x >= v.x_end || y < v.y_begin || y >= v.y_end) return;
+      double const *a = s + 2 * cells * t + in * cells;
+      double *b = s + 2 * cells * t + (1 - in) * cells;
+      b[c] = c0 * a[c] + c1 * (a[c - ey] + a[c + ey] + a[c - 1] + a[c + 1]);
+    });
+  }
+
+  // Write the tiles, which the last time step wrote to buffer `steps % 2`, back:
+  long const tile_cells = p.tile_x() * p.tile_y();
+  auto owned = std::views::iota(0L, p.ntiles() * tile_cells);
+  return std::transform_reduce(
+      std::execution::par, owned.begin(), owned.end(), 0., std::plus{}, [=](long i) {
+        long t = i / tile_cells, c = i % tile_cells;
+        auto g = tile(t, p);
+        auto e = extended(g, p);
+        long gy = g.y_end - g.y_begin, x = g.x_begin + c / gy, y = g.y_begin + c % gy;
+        if (x >= g.x_end) return 0.;
+        long ey = e.y_end - e.y_begin;
+        u_new(x, y) = s[2 * cells * t + (steps % 2) * cells + (x - e.x_begin) * ey + (y - e.y_begin)];
+        return u_new(x, y) * p.dx * p.dx;
+      });
+}
+#else
+double sweep_tile(grid_t u_new, grid_t u_old, grid g, long steps, parameters p, double *a, double *b);
+
+// Advances the solution by `steps <= k` time steps and returns the energy of the last one.
+double sweep(grid_t u_new, grid_t u_old, long steps, parameters p) {
+  assert(steps <= p.k);
+  auto ts = std::views::iota(0L, p.ntiles());
+  return std::transform_reduce(
+      std::execution::par, ts.begin(), ts.end(), 0., std::plus{},
+      [=](long t) {
+        thread_local std::vector<double> ab(2 * (p.tile_x() + 2 * p.k) * (p.tile_y() + 2 * p.k));
+        double *a = ab.data(), *b = a + ab.size() / 2;
+        return sweep_tile(u_new, u_old, tile(t, p), steps, p, a, b);
+      });
+}
+#endif
+
+// Initial condition
+void initial_condition(grid_t u_new, grid_t u_old, parameters p) {
+  std::fill_n(std::execution::par, u_old.data_handle(), u_old.size(), 0.0);
+  std::fill_n(std::execution::par, u_new.data_handle(), u_new.size(), 0.0);
+  // The boundary condition of the first rank lives in its (never exchanged) prev halo layers:
+  if (p.rank == 0) {
+    std::fill_n(std::execution::par, u_old.data_handle(), p.k * p.ny, 1.0);
+    std::fill_n(std::execution::par, u_new.data_handle(), p.k * p.ny, 1.0);
+  }
+}
+
+// These exchange the `k` halo layers with the neighboring ranks.
+void prev(grid_t u_old, parameters p);
+void next(grid_t u_old, parameters p);
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nx + 2 * p.k, p.ny};
+  grid_t u_old{u_old_data.data(), p.nx + 2 * p.k, p.ny};
+
+  // Initial condition
+  initial_condition(u_new, u_old, p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  // The time steps of a sweep are fused, so every sweep adds its duration per time step:
+  benchmark::result per_step{"heat solutions/exercise1_temporal", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  for (long it = 0; it < p.nit(); it += p.k) {
+    auto sweep_start = benchmark::clock::now();
+    // Exchange halos once per sweep, then evolve the solution by up to k time steps:
+    long steps = std::min(p.k, p.nit() - it);
+    trace::range r("prev");
+    prev(u_old, p);
+    r.next("next");
+    next(u_old, p);
+    r.next("sweep");
+    double energy = sweep(u_new, u_old, steps, p);
+
+    // Reduce the energy across all neighbors to the rank == 0, and print it if the sweep
+    // crossed an output step; the first sweep contains step 0, but (0 - 1) / nout() is 0:
+    r.next("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (p.rank == 0 && (it == 0 || (it + steps - 1) / p.nout() != (it - 1) / p.nout())) {
+      std::cerr << "E(t=" << (it + steps - 1) * p.dt << ") = " << energy << std::endl;
+    }
+    std::swap(u_new, u_old);
+    per_step.add(benchmark::seconds_since(sweep_start) / static_cast<double>(steps));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  // Memory traffic actually moved per sweep: each tile reads its extended region once and
+  // writes its owned cells once.
+  double sweep_cells = 0.;
+  for (long t = 0; t < p.ntiles(); ++t) {
+    auto g = tile(t, p), e = extended(g, p);
+    sweep_cells += (e.x_end - e.x_begin) * (e.y_end - e.y_begin) + (g.x_end - g.x_begin) * (g.y_end - g.y_begin);
+  }
+  auto nsweeps = static_cast<double>((p.nit() + p.k - 1) / p.k);
+  auto dram_size = sweep_cells * sizeof(double) * nsweeps * 1e-9; // GB
+  auto dram_bw = dram_size / time;                                // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB), "
+              << p.k << " steps per sweep: " << memory_bw << " GB/s effective, " << dram_bw << " GB/s DRAM ("
+              << dram_size << " GB moved)" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s effective, " << dram_bw * p.nranks << " GB/s DRAM" << std::endl;
+    benchmark::report(per_step);
+  }
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, u_old.data_handle() + p.k * p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4 && argc != 5) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni> [<k>]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  if (argc == 5) k = std::stoll(argv[4]);
+  if (k < 1 || k > nx) {
+    std::cerr << "ERROR: steps per sweep k = " << k << " must be in [1, nx]" << std::endl;
+    std::terminate();
+  }
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+#if !defined(_NVHPC_STDPAR_GPU)
+// Advances tile `g` by `steps` time steps in the scratch buffers `a` and `b`, writes the result
+// to `u_new`, and returns its energy.
+//
+// The extended tile is copied to both buffers once. Each time step then shrinks the valid region
+// by one cell per side, such that after `steps <= k` time steps only the tile itself is valid.
+// Cells that hold boundary conditions are never updated, so both buffers keep them.
+double sweep_tile(grid_t u_new, grid_t u_old, grid g, long steps, parameters p, double *a, double *b) {
+  auto e = extended(g, p);
+  long ex = e.x_end - e.x_begin, ey = e.y_end - e.y_begin;
+  for (long x = 0; x < ex; ++x) {
+    for (long y = 0; y < ey; ++y) {
+      a[x * ey + y] = b[x * ey + y] = u_old(e.x_begin + x, e.y_begin + y);
+    }
+  }
+
+  double c0 = 1. - 4. * p.gamma(), c1 = p.gamma();
+  for (long s = 1; s <= steps; ++s) {
+    auto v = updated(g, s, p);
+    long xb = v.x_begin - e.x_begin, xe = v.x_end - e.x_begin;
+    long yb = v.y_begin - e.y_begin, ye = v.y_end - e.y_begin;
+    for (long x = xb; x < xe; ++x) {
+      double const *c = a + x * ey, *l = c - ey, *r = c + ey;
+      double *o = b + x * ey;
+      for (long y = yb; y < ye; ++y) {
+        o[y] = c0 * c[y] + c1 * (l[y] + r[y] + c[y - 1] + c[y + 1]);
+      }
+    }
+    std::swap(a, b);
+  }
+
+  double energy = 0.;
+  for (long x = g.x_begin; x < g.x_end; ++x) {
+    for (long y = g.y_begin; y < g.y_end; ++y) {
+      u_new(x, y) = a[(x - e.x_begin) * ey + (y - e.y_begin)];
+      energy += u_new(x, y) * p.dx * p.dx;
+    }
+  }
+  return energy;
+}
+#endif
+
+// Exchanges the `k` halo layers with the previous MPI rank (rank - 1)
+void prev(grid_t u_old, parameters p) {
+  if (p.rank > 0) {
+    // Send the first k owned rows to the bottom rank and receive its last k owned rows
+    MPI_Sendrecv(u_old.data_handle() + p.k * p.ny, p.k * p.ny, MPI_DOUBLE, p.rank - 1, 0,
+                 u_old.data_handle(), p.k * p.ny, MPI_DOUBLE, p.rank - 1, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+}
+
+// Exchanges the `k` halo layers with the next MPI rank (rank + 1)
+void next(grid_t u_old, parameters p) {
+  if (p.rank < p.nranks - 1) {
+    // Send the last k owned rows to the top rank and receive its first k owned rows
+    MPI_Sendrecv(u_old.data_handle() + p.nx * p.ny, p.k * p.ny, MPI_DOUBLE, p.rank + 1, 1,
+                 u_old.data_handle() + (p.nx + p.k) * p.ny, p.k * p.ny, MPI_DOUBLE, p.rank + 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+}
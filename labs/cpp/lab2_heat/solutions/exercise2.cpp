@@ -37,6 +37,8 @@
 #include <thread>
 #include <atomic>
 #include <barrier>
+#include <bench.hpp>
+#include <trace.hpp>
 
 // Problem parameters
 struct parameters {
@@ -100,6 +102,9 @@ int main(int argc, char *argv[]) {
   // DONE: Use a shared barrier for synchronizing three threads:
   std::barrier bar(3);
 
+  // Duration of every time step, measured by the "inner" thread:
+  benchmark::result steps{"heat solutions/exercise2", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+
   // DONE: Create three threads each running either "prev", "next", or "inner".
   //       This demonstrates it for "prev":
   std::thread thread_prev([p, u_new = u_new.data(), u_old = u_old.data(), 
@@ -133,16 +138,20 @@ int main(int argc, char *argv[]) {
 
   // DONE: In one of the threads we need to perform the MPI Reduction and I/O; we will do so on the "inner" thread.
   std::thread thread_inner([p, u_new = u_new.data(), u_old = u_old.data(), 
-                            &energy, &bar /* DONE: capture clauses */]() mutable {
+                            &energy, &bar, &steps /* DONE: capture clauses */]() mutable {
     for (long it = 0; it < p.nit(); ++it) {
+      auto step = benchmark::clock::now();
       energy += inner(u_new, u_old, p);
       // DONE: Arrive and Wait on the barrier to block until all three threads have modified the shared "energy" state.
       bar.arrive_and_wait();
     
       // NOTE: Only one of the threads performs the MPI Reduction and I/O; we do so on the "inner" thread.
       // Reduce the energy across all neighbors to the rank == 0, and print it if necessary:
-      MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
-                 MPI_COMM_WORLD);
+      {
+        trace::range r("MPI_Reduce");
+        MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+                   MPI_COMM_WORLD);
+      }
       if (p.rank == 0 && it % p.nout() == 0) {
         std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
       }
@@ -153,6 +162,7 @@ int main(int argc, char *argv[]) {
     
       // DONE: Arrive and Wait on the barrier again to unblock all threads.
       bar.arrive_and_wait();
+      steps.add(benchmark::seconds_since(step));
     }
   });
 
@@ -169,9 +179,11 @@ int main(int argc, char *argv[]) {
               << memory_bw << " GB/s" << std::endl;
     std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): " 
               << memory_bw * p.nranks << " GB/s" << std::endl; 
+    benchmark::report(steps);
   }
 
   // Write output to file
+  trace::range output("output");
   MPI_File f;
   MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
   auto header_bytes = 2 * sizeof(long) + sizeof(double);
@@ -190,6 +202,7 @@ int main(int argc, char *argv[]) {
   MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
   MPI_File_close(&f);
 
+  output.next("MPI_Finalize");
   MPI_Finalize();
   return 0;
 }
@@ -259,6 +272,7 @@ void initial_condition(double* u_new, double* u_old, long n) {
 // Evolve the solution of the interior part of the domain
 // which does not depend on data from neighboring ranks
 double inner(double *u_new, double *u_old, parameters p) {
+  trace::range r("inner");
   grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
   return apply_stencil(u_new, u_old, g, p);
 }
@@ -266,6 +280,7 @@ double inner(double *u_new, double *u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the previous MPI rank (rank - 1)
 double prev(double *u_new, double *u_old, parameters p) {
+  trace::range r("prev");
   // Send window cells, receive halo cells
   if (p.rank > 0) {
     // Send bottom boundary to bottom rank
@@ -281,6 +296,7 @@ double prev(double *u_new, double *u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the next MPI rank (rank + 1)
 double next(double *u_new, double *u_old, parameters p) {
+  trace::range r("next");
   if (p.rank < p.nranks - 1) {
     // Receive bottom boundary from top rank
     MPI_Recv(u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
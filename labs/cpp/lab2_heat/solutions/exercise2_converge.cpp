@@ -0,0 +1,387 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise2_reduce that stops the time loop once the solution reaches a steady state.
+//! The optional arguments `<tol> <ncheck>` make `ni` a maximum number of time steps: every `ncheck`
+//! steps, the global energy is reduced with the non-blocking `MPI_Iallreduce` of exercise2_reduce,
+//! which completes at the end of the following step. Once the relative change of the energy per
+//! time step since the previous reduction falls below `tol`, the completion function of the
+//! time-step barrier stops the three threads after the step that completed the reduction. All ranks
+//! stop at the same step, since they all decide from the same globally reduced energy.
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <vector>
+#include <cartesian_product.hpp> // Brings C++23 std::views::cartesian_product to C++20
+#include <algorithm> // For std::fill_n
+#include <numeric>   // For std::transform_reduce
+#include <execution> // For std::execution::par
+#include <thread>
+#include <barrier>
+#include <bench.hpp>
+#include <trace.hpp>
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  double tol = 0.; // Relative change of the energy per time step below which the loop stops
+  long ncheck = 100; // Time steps between two convergence checks
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  bool converging() { return tol > 0.; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+};
+
+// Tasks that evolve different parts of the local domain; also the summation order of their energies.
+enum task { task_prev, task_inner, task_next, ntasks };
+
+// Energy reduction across tasks and ranks, and convergence control of the time loop.
+//
+// Every task owns one slot that only it writes, padded to a cacheline so that the tasks do not
+// false-share. `complete_step` must only run while no task is writing, i.e., as the completion
+// function of the barrier that ends every time step, which also makes `done` safe to read from
+// every task between two barriers.
+struct energy_reduction {
+  static constexpr std::size_t cacheline = 64;
+  struct alignas(cacheline) slot {
+    double value = 0.;
+  };
+  std::array<slot, ntasks> partial;
+
+  // In-flight MPI_Iallreduce and the time step it reduces:
+  double local = 0., global = 0.;
+  long it_reduced = -1;
+  MPI_Request req = MPI_REQUEST_NULL;
+  long it = 0;
+  parameters p;
+
+  // Last reduced energy and its time step, which the next reduction compares against:
+  double e_checked = 0.;
+  long it_checked = -1;
+  bool converged = false;
+
+  // Duration of every time step, the current one of which started at `step_start`:
+  benchmark::result steps;
+  benchmark::clock::time_point step_start = benchmark::clock::now();
+
+  energy_reduction(parameters p)
+    : p(p), steps{"heat solutions/exercise2_converge", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}} {}
+  double& operator[](task t) { return partial[t].value; }
+  // Whether the time loop is over; `it` is then the number of time steps it ran.
+  bool done() { return converged || it == p.nit(); }
+  void complete_step() noexcept;
+  // Prints and checks the energy of the completed reduction.
+  void reduced() noexcept;
+  // Completes the last reduction, if any; must be called after the time loop.
+  void finish();
+};
+
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(double* u_new, double* u_old, grid g, parameters p);
+void initial_condition(double* u_new, double* u_old, long n);
+
+// These evolve the solution of different parts of the local domain.
+double inner(double* u_new, double* u_old, parameters p);
+double prev (double* u_new, double* u_old, parameters p);
+double next (double* u_new, double* u_old, parameters p);
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new(p.n()), u_old(p.n());
+
+  // Initial condition
+  initial_condition(u_new.data(), u_old.data(), p.n());
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  energy_reduction energy(p);
+
+  // NOTE: the completion function runs on one of the threads after all three have arrived and
+  // before any of them is released, so it can read every slot without further synchronization.
+  std::barrier bar(ntasks, [&energy]() noexcept { energy.complete_step(); });
+
+  std::thread thread_prev([p, u_new = u_new.data(), u_old = u_old.data(),
+                           &energy, &bar]() mutable {
+      while (!energy.done()) {
+          energy[task_prev] = prev(u_new, u_old, p);
+          bar.arrive_and_wait();
+          std::swap(u_new, u_old);
+      }
+  });
+
+  std::thread thread_next([p, u_new = u_new.data(), u_old = u_old.data(),
+                           &energy, &bar]() mutable {
+      while (!energy.done()) {
+          energy[task_next] = next(u_new, u_old, p);
+          bar.arrive_and_wait();
+          std::swap(u_new, u_old);
+      }
+  });
+
+  std::thread thread_inner([p, u_new = u_new.data(), u_old = u_old.data(),
+                            &energy, &bar]() mutable {
+    while (!energy.done()) {
+      energy[task_inner] = inner(u_new, u_old, p);
+      bar.arrive_and_wait();
+      std::swap(u_new, u_old);
+    }
+  });
+
+  thread_prev.join();
+  thread_next.join();
+  thread_inner.join();
+  energy.finish();
+  long nit = energy.it;
+  if (p.rank == 0 && p.converging()) {
+    std::cerr << (energy.converged ? "Converged" : "Not converged") << " after " << nit << " of " << p.nit()
+              << " time steps" << std::endl;
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(nit) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(energy.steps);
+  }
+
+  // The threads swap their own copies of the pointers, so the latest solution is in u_old only if
+  // the number of time steps that ran is even:
+  if (nit % 2 == 1) std::swap(u_new, u_old);
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = nit * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, u_old.data() + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc < 4 || argc > 6) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni> [<tol> [<ncheck>]]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  if (argc > 4) tol = std::stod(argv[4]);
+  if (argc > 5) ncheck = std::stoll(argv[5]);
+  if (tol < 0. || ncheck < 1) {
+    std::cerr << "ERROR: <tol> must not be negative and <ncheck> must be positive" << std::endl;
+    std::terminate();
+  }
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil
+double stencil(double *u_new, double *u_old, long x, long y, parameters p) {
+  auto idx = [=](auto x, auto y) { 
+      // Index into the memory using row-major order:
+      assert(x >= 0 && x < 2 * p.nx);
+      assert(y >= 0 && y < p.ny);
+      return x * p.ny + y;
+  };
+  // Apply boundary conditions:
+  if (y == 1) {
+    u_old[idx(x, y - 1)] = 0;
+  }
+  if (y == (p.ny - 2)) {
+    u_old[idx(x, y + 1)] = 0;
+  }
+  // These boundary conditions are only impossed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) {
+    u_old[idx(x - 1, y)] = 1;
+  }
+  if (p.rank == (p.nranks - 1) && x == p.nx) {
+    u_old[idx(x + 1, y)] = 0;
+  }
+
+  u_new[idx(x, y)] = (1. - 4. * p.gamma()) * u_old[idx(x, y)] +
+                     p.gamma() * (u_old[idx(x + 1, y)] + u_old[idx(x - 1, y)] +
+                                  u_old[idx(x, y + 1)] + u_old[idx(x, y - 1)]);
+
+  return u_new[idx(x, y)] * p.dx * p.dx;
+}
+
+double apply_stencil(double* u_new, double* u_old, grid g, parameters p) {
+  auto xs = std::views::iota(g.x_begin, g.x_end);
+  auto ys = std::views::iota(g.y_begin, g.y_end);
+  auto ids = std::views::cartesian_product(xs, ys);
+  return std::transform_reduce(
+    std::execution::par, ids.begin(), ids.end(), 
+    0., std::plus{}, [u_new, u_old, p](auto idx) {
+      auto [x, y] = idx;
+      return stencil(u_new, u_old, x, y, p);
+  });
+}
+
+// Initial condition
+void initial_condition(double* u_new, double* u_old, long n) {
+  std::fill_n(std::execution::par, u_old, n, 0.0);
+  std::fill_n(std::execution::par, u_new, n, 0.0);
+}
+
+// Evolve the solution of the interior part of the domain
+// which does not depend on data from neighboring ranks
+double inner(double *u_new, double *u_old, parameters p) {
+  trace::range r("inner");
+  grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the previous MPI rank (rank - 1)
+double prev(double *u_new, double *u_old, parameters p) {
+  trace::range r("prev");
+  // Send window cells, receive halo cells
+  if (p.rank > 0) {
+    // Send bottom boundary to bottom rank
+    MPI_Send(u_old + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0, MPI_COMM_WORLD);
+    // Receive top boundary from bottom rank
+    MPI_Recv(u_old + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the next MPI rank (rank + 1)
+double next(double *u_new, double *u_old, parameters p) {
+  trace::range r("next");
+  if (p.rank < p.nranks - 1) {
+    // Receive bottom boundary from top rank
+    MPI_Recv(u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+    // Send top boundary to top rank, and
+    MPI_Send(u_old + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1, MPI_COMM_WORLD);
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Ends time step `it`: completes the reduction started on the previous reduced step, which had a
+// whole time step to progress, starts the one of this step on output and convergence check steps,
+// unless it converged, and records the duration of the step.
+void energy_reduction::complete_step() noexcept {
+  if (req != MPI_REQUEST_NULL) {
+    trace::range r("MPI_Wait");
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+    reduced();
+  }
+  bool check = p.converging() && it % p.ncheck == 0;
+  if (!converged && (it % p.nout() == 0 || check)) {
+    // Fixed summation order, independent of which task finished first:
+    local = 0.;
+    for (auto& s : partial) local += s.value;
+    it_reduced = it;
+    trace::range r("MPI_Iallreduce");
+    MPI_Iallreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD, &req);
+  }
+  ++it;
+  steps.add(benchmark::seconds_since(step_start));
+  step_start = benchmark::clock::now();
+}
+
+void energy_reduction::reduced() noexcept {
+  if (p.rank == 0 && it_reduced % p.nout() == 0) {
+    std::cerr << "E(t=" << it_reduced * p.dt << ") = " << global << std::endl;
+  }
+  if (it_checked >= 0) {
+    // Relative change per time step, since output and check steps need not be evenly spaced:
+    double change = std::abs(global - e_checked) / static_cast<double>(it_reduced - it_checked);
+    converged = p.converging() && change < p.tol * std::abs(global);
+  }
+  e_checked = global;
+  it_checked = it_reduced;
+}
+
+void energy_reduction::finish() {
+  if (req != MPI_REQUEST_NULL) {
+    trace::range r("MPI_Wait");
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+    reduced();
+  }
+}
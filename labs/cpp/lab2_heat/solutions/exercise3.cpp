@@ -36,6 +36,8 @@
 // DONE: add C++ standard library includes as necessary
 #include <exec/static_thread_pool.hpp>
 #include <exec/on.hpp>
+#include <bench.hpp>
+#include <trace.hpp>
 
 // DONE: add stde namespace alias for stdexec
 namespace stde = ::stdexec;
@@ -80,6 +82,7 @@ stde::sender auto iteration_step(stde::scheduler auto&& sch, parameters& p, long
     return stde::when_all(prev_task, next_task, inner_task)
          | stde::then([&](double e0, double e1, double e2) mutable {
              double e = e0 + e1 + e2;
+             trace::range r("MPI_Reduce");
              MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &e, &e, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
              if (p.rank == 0 && it % p.nout() == 0) {
                std::cerr << "E(t=" << it * p.dt << ") = " << e << std::endl;
@@ -120,11 +123,14 @@ int main(int argc, char *argv[]) {
   // DONE: get an scheduler from the context
   stde::scheduler auto sch = ctx.get_scheduler();
     
+  benchmark::result steps{"heat solutions/exercise3", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
   long it = 0;
   auto step = iteration_step(sch, p, it, u_new, u_old);
   for (; it < p.nit(); ++it) {
+    auto step_start = benchmark::clock::now();
     // DONE: block calling  thread on executing a step
     stde::sync_wait(step);
+    steps.add(benchmark::seconds_since(step_start));
   }
 
   auto time = std::chrono::duration<double>(clk_t::now() - start).count();
@@ -135,9 +141,11 @@ int main(int argc, char *argv[]) {
               << memory_bw << " GB/s" << std::endl;
     std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): " 
               << memory_bw * p.nranks << " GB/s" << std::endl; 
+    benchmark::report(steps);
   }
 
   // Write output to file
+  trace::range output("output");
   MPI_File f;
   MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
   auto header_bytes = 2 * sizeof(long) + sizeof(double);
@@ -156,6 +164,7 @@ int main(int argc, char *argv[]) {
   MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
   MPI_File_close(&f);
 
+  output.next("MPI_Finalize");
   MPI_Finalize();
   return 0;
 }
@@ -232,6 +241,7 @@ void initial_condition(double* u_new, double* u_old, long n) {
 // Evolve the solution of the interior part of the domain
 // which does not depend on data from neighboring ranks
 double inner(double *u_new, double *u_old, parameters p) {
+  trace::range r("inner");
   grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
   return apply_stencil(u_new, u_old, g, p);
 }
@@ -239,6 +249,7 @@ double inner(double *u_new, double *u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the previous MPI rank (rank - 1)
 double prev(double *u_new, double *u_old, parameters p) {
+  trace::range r("prev");
   // Send window cells, receive halo cells
   if (p.rank > 0) {
     // Send bottom boundary to bottom rank
@@ -254,6 +265,7 @@ double prev(double *u_new, double *u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the next MPI rank (rank + 1)
 double next(double *u_new, double *u_old, parameters p) {
+  trace::range r("next");
   if (p.rank < p.nranks - 1) {
     // Receive bottom boundary from top rank
     MPI_Recv(u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
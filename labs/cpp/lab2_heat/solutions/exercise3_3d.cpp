@@ -0,0 +1,383 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 3D, see the README.
+//!
+//! 3D variant of the 2D solvers: the domain is split along `z` across the MPI ranks, whose halos
+//! are the contiguous `z` planes of a row-major `u(z, y, x)` grid, and each rank evolves its
+//! "prev" plane, its "next" plane, and its inner planes, as in 2D. The time loop is orchestrated
+//! with parallel algorithms only (exercise1), with one std::thread per part of the domain
+//! (exercise2), or with senders (exercise3), selected on the command line.
+//!
+//! On the CPU, the stencil uses 2.5D blocking: the cells of each `y-x` plane are split into tiles,
+//! and each tile streams along `z`, such that the 3 planes of the tile that the stencil reads stay
+//! in cache while it advances. When the planes have too few tiles for all threads, the planes are
+//! also split into chunks along `z`, each of which streams through its own run of planes. On the
+//! GPU, each cell of the 3D index space is one thread.
+//!
+//! The output starts with the header {0, 3, nx, ny, nz} (uint64), which vis.py tells apart from the
+//! {nx, ny} header of the 2D solvers by its leading 0, followed by the time and the values.
+//!
+//! Usage: heat <nx> <ny> <nz> <ni> [algorithms|threads|senders]
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <mdspan>
+#include <mpi.h>
+#include <numeric>
+#include <ranges>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cartesian_product.hpp> // Brings C++23 std::views::cartesian_product to C++20
+#include <exec/static_thread_pool.hpp>
+#include <exec/on.hpp>
+#include <bench.hpp>
+#include <trace.hpp>
+
+namespace stde = ::stdexec;
+
+using grid_t = std::mdspan<double, std::dextents<std::size_t, 3>, std::layout_right>;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, nz, ni;
+  std::string_view orchestration = "algorithms";
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+  // Tile of the 2.5D blocking: 3 planes of (tile_y + 2) x (tile_x + 2) cells fit in the L2 cache.
+  static constexpr long tile_y() { return 16; }
+  static constexpr long tile_x() { return 256; }
+  // Minimum number of planes that a tile streams through: each chunk along z reloads 2 planes.
+  static constexpr long min_chunk_z() { return 8; }
+  long nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nz_global() { return nz * nranks; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long plane() { return ny * nx; }
+  long n() { return plane() * (nz + 2 /* 2 halo planes */); }
+  long ntiles_y() { return (ny - 2 + tile_y() - 1) / tile_y(); }
+  long ntiles_x() { return (nx - 2 + tile_x() - 1) / tile_x(); }
+  long ntiles() { return ntiles_y() * ntiles_x(); }
+  // Number of chunks along z of `nplanes` planes, for about 4 tasks per thread:
+  long nchunks_z(long nplanes) {
+    long wanted = (4 * nthreads + ntiles() - 1) / std::max(ntiles(), 1L);
+    return std::clamp(wanted, 1L, std::max(nplanes / min_chunk_z(), 1L));
+  }
+};
+
+// Finite-difference stencil: 7 points
+double stencil(grid_t u_new, grid_t u_old, long z, long y, long x, parameters p) {
+  u_new(z, y, x) = (1. - 6. * p.gamma()) * u_old(z, y, x) +
+                   p.gamma() * (u_old(z + 1, y, x) + u_old(z - 1, y, x) + u_old(z, y + 1, x) +
+                                u_old(z, y - 1, x) + u_old(z, y, x + 1) + u_old(z, y, x - 1));
+  return u_new(z, y, x) * p.dx * p.dx * p.dx;
+}
+
+// 2D grid of indices of a tile of a y-x plane
+struct grid {
+  long y_begin, y_end, x_begin, x_end;
+};
+
+// Returns the tile `t` of the interior cells of the y-x planes: [1, ny - 1) x [1, nx - 1).
+grid tile(long t, parameters p) {
+  long ty = t / p.ntiles_x(), tx = t % p.ntiles_x();
+  long y_begin = 1 + ty * p.tile_y(), x_begin = 1 + tx * p.tile_x();
+  return {.y_begin = y_begin,
+          .y_end = std::min(y_begin + p.tile_y(), p.ny - 1),
+          .x_begin = x_begin,
+          .x_end = std::min(x_begin + p.tile_x(), p.nx - 1)};
+}
+
+// Evolves the interior cells of the planes [z_begin, z_end) and returns their energy
+double apply_stencil(grid_t u_new, grid_t u_old, long z_begin, long z_end, parameters p) {
+#if defined(_NVHPC_STDPAR_GPU)
+  auto ids = std::views::cartesian_product(std::views::iota(z_begin, z_end), std::views::iota(1L, p.ny - 1),
+                                           std::views::iota(1L, p.nx - 1));
+  return std::transform_reduce(std::execution::par, ids.begin(), ids.end(), 0., std::plus{},
+                               [u_new, u_old, p](auto idx) {
+                                 auto [z, y, x] = idx;
+                                 return stencil(u_new, u_old, z, y, x, p);
+                               });
+#else
+  // Each task is one tile of one chunk of planes:
+  long nplanes = z_end - z_begin, nchunks = p.nchunks_z(nplanes), ntiles = p.ntiles();
+  auto ts = std::views::iota(0L, ntiles * nchunks);
+  return std::transform_reduce(std::execution::par, ts.begin(), ts.end(), 0., std::plus{},
+                               [u_new, u_old, z_begin, nplanes, nchunks, ntiles, p](long t) {
+                                 auto g = tile(t % ntiles, p);
+                                 long c = t / ntiles;
+                                 long zb = z_begin + c * nplanes / nchunks;
+                                 long ze = z_begin + (c + 1) * nplanes / nchunks;
+                                 double energy = 0.;
+                                 for (long z = zb; z < ze; ++z) {
+                                   for (long y = g.y_begin; y < g.y_end; ++y) {
+                                     for (long x = g.x_begin; x < g.x_end; ++x) {
+                                       energy += stencil(u_new, u_old, z, y, x, p);
+                                     }
+                                   }
+                                 }
+                                 return energy;
+                               });
+#endif
+}
+
+// Initial condition: zero, with the boundary conditions on the halos that are not exchanged
+void initial_condition(grid_t u_new, grid_t u_old, parameters p) {
+  for (grid_t u : {u_new, u_old}) {
+    std::fill_n(std::execution::par, u.data_handle(), u.size(), 0.0);
+    // The lower halo plane of the first rank is the hot boundary of the domain:
+    if (p.rank == 0) std::fill_n(std::execution::par, u.data_handle(), p.plane(), 1.0);
+  }
+}
+
+// These evolve the solution of different parts of the local domain.
+double inner(grid_t u_new, grid_t u_old, parameters p);
+double prev(grid_t u_new, grid_t u_old, parameters p);
+double next(grid_t u_new, grid_t u_old, parameters p);
+
+// Reduces the energy of time step `it` across all ranks to the rank == 0, and prints it if necessary
+void reduce(double energy, long it, parameters p) {
+  trace::range r("MPI_Reduce");
+  MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (p.rank == 0 && it % p.nout() == 0) {
+    std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+  }
+}
+
+// Time loop of exercise1: parallel algorithms on the calling thread. Every time loop adds the
+// duration of each time step to `steps`.
+void time_loop_algorithms(grid_t u_new, grid_t u_old, parameters p, benchmark::result& steps) {
+  for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
+    reduce(prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p), it, p);
+    std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
+  }
+}
+
+// Time loop of exercise2: one thread per part of the domain, which synchronize on a barrier
+void time_loop_threads(grid_t u_new, grid_t u_old, parameters p, benchmark::result& steps) {
+  std::atomic<double> energy = 0.;
+  std::barrier bar(3);
+  // "prev" and "next" add their energy and wait twice: for all energies, then for the reduction.
+  auto boundary = [&, u_new, u_old, p](auto part) mutable {
+    for (long it = 0; it < p.nit(); ++it) {
+      energy += part(u_new, u_old, p);
+      bar.arrive_and_wait();
+      bar.arrive_and_wait();
+      std::swap(u_new, u_old);
+    }
+  };
+  std::thread thread_prev(boundary, prev);
+  std::thread thread_next(boundary, next);
+  std::thread thread_inner([&, u_new, u_old, p]() mutable {
+    for (long it = 0; it < p.nit(); ++it) {
+      auto step = benchmark::clock::now();
+      energy += inner(u_new, u_old, p);
+      bar.arrive_and_wait();
+      reduce(energy, it, p);
+      energy = 0.;
+      std::swap(u_new, u_old);
+      bar.arrive_and_wait();
+      steps.add(benchmark::seconds_since(step));
+    }
+  });
+  thread_prev.join();
+  thread_next.join();
+  thread_inner.join();
+}
+
+// Time loop of exercise3: a sender of one time step, which runs the parts of the domain on `sch`
+void time_loop_senders(grid_t u_new, grid_t u_old, parameters p, benchmark::result& steps) {
+  exec::static_thread_pool ctx{3};
+  stde::scheduler auto sch = ctx.get_scheduler();
+  long it = 0;
+  auto prev_task = stde::just() | exec::on(sch, stde::then([&] { return prev(u_new, u_old, p); }));
+  auto next_task = stde::just() | exec::on(sch, stde::then([&] { return next(u_new, u_old, p); }));
+  auto inner_task = stde::just() | exec::on(sch, stde::then([&] { return inner(u_new, u_old, p); }));
+  auto step = stde::when_all(prev_task, next_task, inner_task) |
+              stde::then([&](double e0, double e1, double e2) {
+                reduce(e0 + e1 + e2, it, p);
+                std::swap(u_new, u_old);
+              });
+  for (; it < p.nit(); ++it) {
+    auto step_start = benchmark::clock::now();
+    stde::sync_wait(step);
+    steps.add(benchmark::seconds_since(step_start));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new_data(p.n()), u_old_data(p.n());
+  grid_t u_new{u_new_data.data(), p.nz + 2, p.ny, p.nx};
+  grid_t u_old{u_old_data.data(), p.nz + 2, p.ny, p.nx};
+
+  // Initial condition
+  initial_condition(u_new, u_old, p);
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+  benchmark::result steps{"heat solutions/exercise3_3d " + std::string(p.orchestration),
+                          {2. * p.nx * p.ny * p.nz * sizeof(double), 10. * p.nx * p.ny * p.nz}};
+  if (p.orchestration == "algorithms") time_loop_algorithms(u_new, u_old, p, steps);
+  else if (p.orchestration == "threads") time_loop_threads(u_new, u_old, p, steps);
+  else time_loop_senders(u_new, u_old, p, steps);
+  // Every time loop swaps copies of the grids: after an odd number of steps, u_new holds the solution.
+  if (p.nit() % 2 == 1) std::swap(u_new, u_old);
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * p.nz * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;                     // GB/s
+  if (p.rank == 0) {
+    std::cerr << p.orchestration << ": Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << "x"
+              << p.nz << " (" << grid_size << " GB): " << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx << "x" << p.ny << "x" << p.nz_global() << " ("
+              << (grid_size * p.nranks) << " GB): " << memory_bw * p.nranks << " GB/s" << std::endl;
+    benchmark::report(steps);
+  }
+
+  // Write output to file: the owned planes of each rank are contiguous, and written without a copy
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  std::uint64_t header[5] = {0, 3, (std::uint64_t)p.nx, (std::uint64_t)p.ny, (std::uint64_t)p.nz_global()};
+  double t = p.nit() * p.dt;
+  auto header_bytes = sizeof(header) + sizeof(double);
+  auto values_per_rank = p.nz * p.plane();
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, header, 5, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, sizeof(header), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, u_old.data_handle() + p.plane(), values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 5 && argc != 6) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <nz> <ni> [algorithms|threads|senders]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  nz = std::stoll(argv[3]);
+  ni = std::stoll(argv[4]);
+  if (argc == 6) orchestration = argv[5];
+  if (orchestration != "algorithms" && orchestration != "threads" && orchestration != "senders") {
+    std::cerr << "ERROR: unknown orchestration " << orchestration << std::endl;
+    std::terminate();
+  }
+  if (nx < 3 || ny < 3 || nz < 2) {
+    std::cerr << "ERROR: the local domain must be at least 3x3x2" << std::endl;
+    std::terminate();
+  }
+  dx = 1.0 / nx;
+  // Explicit Euler is stable for gamma <= 1/6 in 3D; as in 2D, use 80% of that.
+  dt = dx * dx / (7.5 * alpha());
+}
+
+// Evolve the solution of the inner planes of the domain
+// which do not depend on data from neighboring ranks
+double inner(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("inner");
+  return apply_stencil(u_new, u_old, 2, p.nz, p);
+}
+
+// Evolve the solution of the plane of the domain that
+// depends on data from the previous MPI rank (rank - 1)
+double prev(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("prev");
+  thread_local std::vector<double> halos_tx((std::size_t)p.plane());
+  thread_local std::vector<double> halos_rx((std::size_t)p.plane());
+  // Send the first owned plane, receive the lower halo plane
+  if (p.rank > 0) {
+    // Copy halos to transmit into the transmit buffer
+    std::copy_n(std::execution::par, u_old.data_handle() + p.plane(), p.plane(), halos_tx.begin());
+    // Send bottom boundary to bottom rank and receive top boundary from bottom rank
+    MPI_Sendrecv(halos_tx.data(), p.plane(), MPI_DOUBLE, p.rank - 1, 0,
+                 halos_rx.data(), p.plane(), MPI_DOUBLE, p.rank - 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy data from the receive buffer into the grid
+    std::copy_n(std::execution::par, halos_rx.begin(), p.plane(), u_old.data_handle());
+  }
+  return apply_stencil(u_new, u_old, 1, 2, p);
+}
+
+// Evolve the solution of the plane of the domain that
+// depends on data from the next MPI rank (rank + 1)
+double next(grid_t u_new, grid_t u_old, parameters p) {
+  trace::range r("next");
+  thread_local std::vector<double> halos_tx((std::size_t)p.plane());
+  thread_local std::vector<double> halos_rx((std::size_t)p.plane());
+  // Send the last owned plane, receive the upper halo plane
+  if (p.rank < p.nranks - 1) {
+    // Copy halos to transmit into the transmit buffer
+    std::copy_n(std::execution::par, u_old.data_handle() + p.nz * p.plane(), p.plane(), halos_tx.begin());
+    // Receive bottom boundary from top rank and send top boundary to top rank
+    MPI_Sendrecv(halos_tx.data(), p.plane(), MPI_DOUBLE, p.rank + 1, 0,
+                 halos_rx.data(), p.plane(), MPI_DOUBLE, p.rank + 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Copy received halos to the u_old solution buffer
+    std::copy_n(std::execution::par, halos_rx.begin(), p.plane(), u_old.data_handle() + (p.nz + 1) * p.plane());
+  }
+  return apply_stencil(u_new, u_old, p.nz, p.nz + 1, p);
+}
@@ -0,0 +1,368 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise3 that builds the whole time loop as a single sender, such that the calling
+//! thread blocks in `sync_wait` only once instead of once per time step. The halo exchange, the
+//! energy reduction and the I/O run on a host scheduler, and the stencil runs as `bulk` on a
+//! compute scheduler: an `nvexec::stream_context` in the GPU build (`-stdpar=gpu`), and an
+//! `exec::static_thread_pool` otherwise.
+//!
+//! As a reference, the same time steps, including the energy reduction, are first run as plain
+//! parallel algorithms without any sender, and the time per step of both loops is reported. Their
+//! difference mixes the gain of overlapping the boundary and inner rows, which the reference runs one
+//! after the other, with the overhead of the senders. Thus, the overhead is measured on its own by
+//! the same senders with empty bulks, which do no work.
+//!
+//! The `prev`, `next` and `MPI_Reduce` ranges of the host tasks are emitted by both loops. The
+//! `boundary` and `inner` ranges are only emitted by the reference loop: the bulks of the sender
+//! graph run on the compute scheduler, which has no host scope around them to annotate.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <cartesian_product.hpp> // Brings C++23 std::views::cartesian_product to C++20
+#include <exec/repeat_effect_until.hpp>
+#include <exec/static_thread_pool.hpp>
+#include <bench.hpp>
+#include <trace.hpp>
+#if defined(_NVHPC_STDPAR_GPU)
+#include <nvexec/stream_context.cuh>
+#endif
+
+namespace stde = ::stdexec;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+  // Cells of the boundary rows x = 1 and x = nx, and of the inner rows [2, nx):
+  long nboundary() { return 2 * (ny - 2); }
+  long ninner() { return std::max(nx - 2, 0L) * (ny - 2); }
+};
+
+// State of the time loop shared by all tasks.
+//
+// The sender of a time step is built once and run `nit` times, so its tasks must read the current
+// buffers from here instead of capturing them. It is heap-allocated, such that GPU kernels can
+// access it when memory is managed.
+struct state {
+  parameters p;
+  double *u_new, *u_old;
+  long it = 0;
+  bool print = true; // Whether end_step prints the energy
+  // If set, end_step adds the duration of every time step, which started at `step_start`, to it:
+  benchmark::result *steps = nullptr;
+  benchmark::clock::time_point step_start = {};
+};
+
+double stencil(double *u_new, double *u_old, long x, long y, parameters p);
+void initial_condition(double* u_new, double* u_old, long n);
+void exchange(state *s);
+void boundary_cell(state *s, long i);
+void inner_cell(state *s, long i);
+void end_step(state *s);
+void record_step(state *s);
+
+// One time step: the boundary rows are computed once the halos have been exchanged on the host,
+// while the inner rows are computed concurrently. The sender completes on the `host` scheduler.
+stde::sender auto iteration_step(stde::scheduler auto compute, stde::scheduler auto host, state *s) {
+  auto boundary = stde::schedule(host)
+                | stde::then([s] { exchange(s); })
+                | stde::continues_on(compute)
+                | stde::bulk(s->p.nboundary(), [s](long i) { boundary_cell(s, i); });
+  auto inner = stde::schedule(compute)
+             | stde::bulk(s->p.ninner(), [s](long i) { inner_cell(s, i); });
+  return stde::when_all(std::move(boundary), std::move(inner))
+       | stde::continues_on(host)
+       | stde::then([s] { end_step(s); });
+}
+
+// The senders of `iteration_step` with empty bulks, which only schedule a time step.
+stde::sender auto empty_step(stde::scheduler auto compute, stde::scheduler auto host, state *s) {
+  auto boundary = stde::schedule(host)
+                | stde::continues_on(compute)
+                | stde::bulk(s->p.nboundary(), [](long) {});
+  auto inner = stde::schedule(compute)
+             | stde::bulk(s->p.ninner(), [](long) {});
+  return stde::when_all(std::move(boundary), std::move(inner))
+       | stde::continues_on(host)
+       | stde::then([s] {
+           ++s->it;
+           record_step(s);
+         });
+}
+
+// The whole time loop as one sender: repeats `step` until all time steps are done.
+stde::sender auto time_loop(stde::sender auto step, state *s) {
+  return exec::repeat_effect_until(std::move(step) | stde::then([s] { return s->it == s->p.nit(); }));
+}
+
+// Reference time loop that runs the same time steps as parallel algorithms without senders.
+void direct_loop(state *s) {
+  while (s->it < s->p.nit()) {
+    exchange(s);
+    {
+      trace::range r("boundary");
+      std::for_each_n(std::execution::par, std::views::iota(0L).begin(), s->p.nboundary(), [s](long i) { boundary_cell(s, i); });
+      r.next("inner");
+      std::for_each_n(std::execution::par, std::views::iota(0L).begin(), s->p.ninner(), [s](long i) { inner_cell(s, i); });
+    }
+    end_step(s);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new(p.n()), u_old(p.n());
+  auto s = std::make_unique<state>(state{.p = p, .u_new = u_new.data(), .u_old = u_old.data()});
+
+  // The host scheduler performs MPI communication and I/O.
+  exec::static_thread_pool host_ctx{1};
+  stde::scheduler auto host = host_ctx.get_scheduler();
+#if defined(_NVHPC_STDPAR_GPU)
+  nvexec::stream_context compute_ctx{};
+#else
+  exec::static_thread_pool compute_ctx{std::max(1u, std::thread::hardware_concurrency())};
+#endif
+  stde::scheduler auto compute = compute_ctx.get_scheduler();
+
+  using clk_t = std::chrono::steady_clock;
+
+  // Every loop adds the duration of each of its time steps to its own result:
+  benchmark::model step_work{2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny};
+  benchmark::result steps{"heat solutions/exercise3_pipeline", step_work};
+  benchmark::result direct_steps{"heat solutions/exercise3_pipeline, without senders", step_work};
+  benchmark::result empty_steps{"heat solutions/exercise3_pipeline, empty bulks", {}};
+
+  // Reference: the time loop without senders, which reduces but does not print the energy.
+  initial_condition(u_new.data(), u_old.data(), p.n());
+  *s = state{.p = p, .u_new = u_new.data(), .u_old = u_old.data(), .print = false, .steps = &direct_steps};
+  MPI_Barrier(MPI_COMM_WORLD);
+  s->step_start = benchmark::clock::now();
+  direct_loop(s.get());
+
+  // Overhead of the senders: the time loop with empty bulks.
+  *s = state{.p = p, .u_new = u_new.data(), .u_old = u_old.data(), .steps = &empty_steps};
+  MPI_Barrier(MPI_COMM_WORLD);
+  s->step_start = benchmark::clock::now();
+  if (p.nit() > 0) stde::sync_wait(time_loop(empty_step(compute, host, s.get()), s.get()));
+
+  // Time loop: the calling thread blocks once for all time steps.
+  initial_condition(u_new.data(), u_old.data(), p.n());
+  *s = state{.p = p, .u_new = u_new.data(), .u_old = u_old.data(), .steps = &steps};
+  MPI_Barrier(MPI_COMM_WORLD);
+  auto start = clk_t::now();
+  s->step_start = benchmark::clock::now();
+  if (p.nit() > 0) stde::sync_wait(time_loop(iteration_step(compute, host, s.get()), s.get()));
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): "
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): "
+              << memory_bw * p.nranks << " GB/s" << std::endl;
+    std::cerr << "Median time step: " << steps.median() * 1e6 << " us, without senders: "
+              << direct_steps.median() * 1e6 << " us, of empty bulks: " << empty_steps.median() * 1e6 << " us"
+              << std::endl;
+    benchmark::report(steps);
+    benchmark::report(direct_steps);
+    benchmark::report(empty_steps);
+  }
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, s->u_old + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+// Finite-difference stencil
+double stencil(double *u_new, double *u_old, long x, long y, parameters p) {
+  auto idx = [=](auto x, auto y) { 
+      // Index into the memory using row-major order:
+      assert(x >= 0 && x < 2 * p.nx);
+      assert(y >= 0 && y < p.ny);
+      return x * p.ny + y;
+  };
+  // Apply boundary conditions:
+  if (y == 1) {
+    u_old[idx(x, y - 1)] = 0;
+  }
+  if (y == (p.ny - 2)) {
+    u_old[idx(x, y + 1)] = 0;
+  }
+  // These boundary conditions are only impossed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) {
+    u_old[idx(x - 1, y)] = 1;
+  }
+  if (p.rank == (p.nranks - 1) && x == p.nx) {
+    u_old[idx(x + 1, y)] = 0;
+  }
+
+  u_new[idx(x, y)] = (1. - 4. * p.gamma()) * u_old[idx(x, y)] +
+                     p.gamma() * (u_old[idx(x + 1, y)] + u_old[idx(x - 1, y)] +
+                                  u_old[idx(x, y + 1)] + u_old[idx(x, y - 1)]);
+
+  return u_new[idx(x, y)] * p.dx * p.dx;
+}
+
+// Initial condition
+void initial_condition(double* u_new, double* u_old, long n) {
+  std::fill_n(std::execution::par, u_old, n, 0.0);
+  std::fill_n(std::execution::par, u_new, n, 0.0);
+}
+
+// Exchanges the halos of `u_old` with the previous (rank - 1) and next (rank + 1) MPI ranks
+void exchange(state *s) {
+  auto p = s->p;
+  auto u_old = s->u_old;
+  trace::range r("prev");
+  if (p.rank > 0) {
+    // Send bottom boundary to bottom rank, and receive top boundary from bottom rank
+    MPI_Sendrecv(u_old + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0,
+                 u_old + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+  r.next("next");
+  if (p.rank < p.nranks - 1) {
+    // Send top boundary to top rank, and receive bottom boundary from top rank
+    MPI_Sendrecv(u_old + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1,
+                 u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+}
+
+// Evolves the i-th cell of the rows x = 1 and x = nx, which depend on the halos
+void boundary_cell(state *s, long i) {
+  auto p = s->p;
+  long x = i < p.ny - 2 ? 1 : p.nx;
+  long y = 1 + i % (p.ny - 2);
+  stencil(s->u_new, s->u_old, x, y, p);
+}
+
+// Evolves the i-th cell of the rows [2, nx), which do not depend on data from neighboring ranks
+void inner_cell(state *s, long i) {
+  auto p = s->p;
+  long x = 2 + i / (p.ny - 2);
+  long y = 1 + i % (p.ny - 2);
+  stencil(s->u_new, s->u_old, x, y, p);
+}
+
+// Ends a time step on the host: reduces and prints the energy on output steps only, swaps the
+// solution buffers, and records the duration of the step.
+void end_step(state *s) {
+  auto p = s->p;
+  if (s->it % p.nout() == 0) {
+    auto ids = std::views::cartesian_product(std::views::iota(1L, p.nx + 1), std::views::iota(1L, p.ny - 1));
+    double e = std::transform_reduce(
+      std::execution::par, ids.begin(), ids.end(), 0., std::plus{}, [u_new = s->u_new, p](auto idx) {
+        auto [x, y] = idx;
+        return u_new[x * p.ny + y] * p.dx * p.dx;
+    });
+    trace::range r("MPI_Reduce");
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &e, &e, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (p.rank == 0 && s->print) {
+      std::cerr << "E(t=" << s->it * p.dt << ") = " << e << std::endl;
+    }
+  }
+  std::swap(s->u_new, s->u_old);
+  ++s->it;
+  record_step(s);
+}
+
+// Adds the duration of the time step that just ended to `steps`, if set
+void record_step(state *s) {
+  if (s->steps) {
+    s->steps->add(benchmark::seconds_since(s->step_start));
+    s->step_start = benchmark::clock::now();
+  }
+}
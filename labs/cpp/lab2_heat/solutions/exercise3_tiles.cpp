@@ -0,0 +1,319 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Solves heat equation in 2D, see the README.
+//!
+//! Variant of exercise3 without nested parallelism. exercise3 runs three coarse tasks on a pool of
+//! 3 threads, and `inner` forks again into `std::execution::par`, which oversubscribes the cores.
+//! Here, one `exec::static_thread_pool` sized to the machine runs every task, and none of them
+//! forks: the boundary rows run serially in the `prev` and `next` tasks, and the inner rows are split
+//! into tiles of `tile_rows` rows.
+//!
+//! The pool splits a `stde::bulk` into one contiguous chunk of its shape per thread, which balances
+//! neither tiles of different cost nor threads that are busy with the halo exchange. Thus, a time
+//! step is one `bulk` of one worker per thread, and the workers claim the tasks of the step from an
+//! atomic counter, in order: `prev` and `next` first, such that the halo exchange, and thus the next
+//! time step, starts before any inner tile, and then the inner tiles, one at a time, such that the
+//! workers that finish early take over the remaining ones.
+//!
+//! Every task writes its energy into its own cacheline-padded slot, such that the threads do not
+//! false-share, and the slots are summed in task order, independent of which thread ran them.
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+#include <vector>
+#include <algorithm> // For std::fill_n
+#include <atomic>
+#include <cstdint>
+#include <execution> // For std::execution::par
+#include <thread>    // For std::thread::hardware_concurrency
+#include <exec/static_thread_pool.hpp>
+#include <bench.hpp>
+#include <trace.hpp>
+
+namespace stde = ::stdexec;
+
+// Problem parameters
+struct parameters {
+  double dx, dt;
+  long nx, ny, ni;
+  int rank = 0, nranks = 1;
+
+  static constexpr double alpha() { return 1.0; } // Thermal diffusivity
+
+  long tile_rows = 8; // Inner rows per tile
+  long nthreads = std::max(1u, std::thread::hardware_concurrency()); // Threads of the pool
+
+  parameters(int argc, char *argv[]);
+
+  long nit() { return ni; }
+  long nout() { return 1000; }
+  long nx_global() { return nx * nranks; }
+  long ny_global() { return ny; }
+  double gamma() { return alpha() * dt / (dx * dx); }
+  long n() { return ny * (nx + 2 /* 2 halo layers */); }
+  // Tiles of the inner rows [2, nx):
+  long ntiles() { return (std::max(nx - 2, 0L) + tile_rows - 1) / tile_rows; }
+  // Tasks of a time step: `prev`, `next`, and the inner tiles
+  long ntasks() { return 2 + ntiles(); }
+};
+
+// These evolve the solution of different parts of the local domain.
+double inner(double* u_new, double* u_old, long tile, parameters p);
+double prev (double* u_new, double* u_old, parameters p);
+double next (double* u_new, double* u_old, parameters p);
+
+// Energy of one task, padded to a cacheline so that the tasks of different threads do not
+// false-share.
+struct alignas(64) slot {
+  double value = 0.;
+};
+
+// Tasks of one time step, which the workers claim in order: task 0 is `prev`, task 1 is `next`,
+// and task 2 + t is inner tile t.
+struct task_queue {
+  std::atomic<long> next_task = 0;
+  std::vector<slot> energies; // Energy of every task
+};
+
+// Runs the tasks of this time step that the calling worker claims.
+void run_tasks(task_queue& q, double* u_new, double* u_old, parameters p) {
+  for (long t; (t = q.next_task.fetch_add(1, std::memory_order_relaxed)) < p.ntasks();) {
+    q.energies[t].value = t == 0 ? prev(u_new, u_old, p)
+                        : t == 1 ? next(u_new, u_old, p)
+                                 : inner(u_new, u_old, t - 2, p);
+  }
+}
+
+// One time step
+stde::sender auto iteration_step(stde::scheduler auto&& sch, parameters& p, long& it, std::vector<double>& u_new, std::vector<double>& u_old,
+                                 task_queue& q) {
+    return stde::schedule(sch)
+         | stde::then([&] { q.next_task.store(0, std::memory_order_relaxed); })
+         | stde::bulk(p.nthreads, [&](long) { run_tasks(q, u_new.data(), u_old.data(), p); })
+         | stde::then([&] {
+             double e = 0.;
+             for (auto const& s : q.energies) e += s.value;
+             trace::range r("MPI_Reduce");
+             MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &e, &e, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+             if (p.rank == 0 && it % p.nout() == 0) {
+               std::cerr << "E(t=" << it * p.dt << ") = " << e << std::endl;
+              }
+              std::swap(u_new, u_old);
+         });
+}
+
+void initial_condition(double* u_new, double* u_old, long n);
+
+int main(int argc, char *argv[]) {
+  // Parse CLI parameters
+  parameters p(argc, argv);
+
+  // Initialize MPI with multi-threading support
+  int mt;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &mt);
+  if (mt != MPI_THREAD_MULTIPLE) {
+    std::cerr << "MPI cannot be called from multiple host threads" << std::endl;
+    std::terminate();
+  }
+  MPI_Comm_size(MPI_COMM_WORLD, &p.nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
+
+  // Allocate memory
+  std::vector<double> u_new(p.n()), u_old(p.n());
+ 
+  // Initial condition
+  initial_condition(u_new.data(), u_old.data(), p.n());
+
+  // One pool for all tasks and tiles, sized to the machine:
+  exec::static_thread_pool ctx{static_cast<std::uint32_t>(p.nthreads)};
+  task_queue q{.energies = std::vector<slot>(p.ntasks())};
+
+  // Time loop
+  using clk_t = std::chrono::steady_clock;
+  auto start = clk_t::now();
+
+  stde::scheduler auto sch = ctx.get_scheduler();
+
+  benchmark::result steps{"heat solutions/exercise3_tiles", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
+  long it = 0;
+  auto step = iteration_step(sch, p, it, u_new, u_old, q);
+  for (; it < p.nit(); ++it) {
+    auto step_start = benchmark::clock::now();
+    stde::sync_wait(step);
+    steps.add(benchmark::seconds_since(step_start));
+  }
+
+  auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+  auto grid_size = static_cast<double>(p.nx * p.ny * sizeof(double) * 2) * 1e-9; // GB
+  auto memory_bw = grid_size * static_cast<double>(p.nit()) / time;             // GB/s
+  if (p.rank == 0) {
+    std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): " 
+              << memory_bw << " GB/s" << std::endl;
+    std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): " 
+              << memory_bw * p.nranks << " GB/s" << std::endl; 
+    benchmark::report(steps);
+  }
+
+  // Write output to file
+  trace::range output("output");
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, "output", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &f);
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = p.nx * p.ny;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+  MPI_Request req[3] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  // The header must outlive the asynchronous writes, i.e., until MPI_Waitall:
+  long total[2] = {p.nx * p.nranks, p.ny};
+  double t = p.nit() * p.dt;
+  if (p.rank == 0) {
+    MPI_File_iwrite_at(f, 0, total, 2, MPI_UINT64_T, &req[1]);
+    MPI_File_iwrite_at(f, 2 * sizeof(long), &t, 1, MPI_DOUBLE, &req[2]);
+  }
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_iwrite_at(f, values_offset, u_old.data() + p.ny, values_per_rank, MPI_DOUBLE, &req[0]);
+  MPI_Waitall(p.rank == 0 ? 3 : 1, req, MPI_STATUSES_IGNORE);
+  MPI_File_close(&f);
+
+  output.next("MPI_Finalize");
+  MPI_Finalize();
+  return 0;
+}
+                                 
+// 2D grid of indicies
+struct grid {
+  long x_begin, x_end, y_begin, y_end;
+};
+
+double apply_stencil(double* u_new, double* u_old, grid g, parameters p);
+
+// Reads command line arguments to initialize problem size
+parameters::parameters(int argc, char *argv[]) {
+  if (argc != 4 && argc != 5) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni> [<tile_rows>]" << std::endl;
+    std::terminate();
+  }
+  nx = std::stoll(argv[1]);
+  ny = std::stoll(argv[2]);
+  ni = std::stoll(argv[3]);
+  if (argc == 5) tile_rows = std::stoll(argv[4]);
+  if (tile_rows < 1) {
+    std::cerr << "ERROR: <tile_rows> must be positive" << std::endl;
+    std::terminate();
+  }
+  dx = 1.0 / nx;
+  dt = dx * dx / (5. * alpha());
+}
+
+// Finite-difference stencil
+double stencil(double *u_new, double *u_old, long x, long y, parameters p) {
+  auto idx = [=](auto x, auto y) { 
+      // Index into the memory using row-major order:
+      assert(x >= 0 && x < 2 * p.nx);
+      assert(y >= 0 && y < p.ny);
+      return x * p.ny + y;
+  };
+  // Apply boundary conditions:
+  if (y == 1) {
+    u_old[idx(x, y - 1)] = 0;
+  }
+  if (y == (p.ny - 2)) {
+    u_old[idx(x, y + 1)] = 0;
+  }
+  // These boundary conditions are only impossed by the ranks at the end of the domain:
+  if (p.rank == 0 && x == 1) {
+    u_old[idx(x - 1, y)] = 1;
+  }
+  if (p.rank == (p.nranks - 1) && x == p.nx) {
+    u_old[idx(x + 1, y)] = 0;
+  }
+
+  u_new[idx(x, y)] = (1. - 4. * p.gamma()) * u_old[idx(x, y)] +
+                     p.gamma() * (u_old[idx(x + 1, y)] + u_old[idx(x - 1, y)] +
+                                  u_old[idx(x, y + 1)] + u_old[idx(x, y - 1)]);
+
+  return u_new[idx(x, y)] * p.dx * p.dx;
+}
+
+// Applies the stencil serially on the calling thread of the pool
+double apply_stencil(double* u_new, double* u_old, grid g, parameters p) {
+  double energy = 0.;
+  for (long x = g.x_begin; x < g.x_end; ++x) {
+    for (long y = g.y_begin; y < g.y_end; ++y) {
+      energy += stencil(u_new, u_old, x, y, p);
+    }
+  }
+  return energy;
+}
+
+// Initial condition
+void initial_condition(double* u_new, double* u_old, long n) {
+  std::fill_n(std::execution::par, u_old, n, 0.0);
+  std::fill_n(std::execution::par, u_new, n, 0.0);
+}
+
+// Evolve the solution of one tile of the interior part of the domain
+// which does not depend on data from neighboring ranks
+double inner(double *u_new, double *u_old, long tile, parameters p) {
+  trace::range r("inner");
+  long x_begin = 2 + tile * p.tile_rows;
+  grid g{.x_begin = x_begin, .x_end = std::min(x_begin + p.tile_rows, p.nx), .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the previous MPI rank (rank - 1)
+double prev(double *u_new, double *u_old, parameters p) {
+  trace::range r("prev");
+  // Send window cells, receive halo cells
+  if (p.rank > 0) {
+    // Send bottom boundary to bottom rank
+    MPI_Send(u_old + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0, MPI_COMM_WORLD);
+    // Receive top boundary from bottom rank
+    MPI_Recv(u_old + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+  // Compute prev boundary
+  grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
+
+// Evolve the solution of the part of the domain that 
+// depends on data from the next MPI rank (rank + 1)
+double next(double *u_new, double *u_old, parameters p) {
+  trace::range r("next");
+  if (p.rank < p.nranks - 1) {
+    // Receive bottom boundary from top rank
+    MPI_Recv(u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+    // Send top boundary to top rank, and
+    MPI_Send(u_old + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1, MPI_COMM_WORLD);
+  }
+  // Compute next boundary
+  grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
+  return apply_stencil(u_new, u_old, g, p);
+}
\ No newline at end of file
@@ -31,6 +31,7 @@
 #include <mpi.h>
 #include <ranges>
 #include <vector>
+#include <bench.hpp>
 
 using grid_t = std::mdspan<double, std::dextents<std::size_t, 2>, std::layout_right>;
 
@@ -108,7 +109,9 @@ int main(int argc, char *argv[]) {
   using clk_t = std::chrono::steady_clock;
   auto start = clk_t::now();
 
+  benchmark::result steps{"heat starting_point", {2. * p.nx * p.ny * sizeof(double), 9. * p.nx * p.ny}};
   for (long it = 0; it < p.nit(); ++it) {
+    auto step = benchmark::clock::now();
     // Evolve the solution:
     double energy = prev(u_new, u_old, p) + next(u_new, u_old, p) + inner(u_new, u_old, p);
 
@@ -119,6 +122,7 @@ int main(int argc, char *argv[]) {
       std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
     }
     std::swap(u_new, u_old);
+    steps.add(benchmark::seconds_since(step));
   }
 
   auto time = std::chrono::duration<double>(clk_t::now() - start).count();
@@ -129,6 +133,7 @@ int main(int argc, char *argv[]) {
               << memory_bw << " GB/s" << std::endl;
     std::cerr << "All ranks: global domain " << p.nx_global() << "x" << p.ny_global() << " (" << (grid_size * p.nranks) << " GB): " 
               << memory_bw * p.nranks << " GB/s" << std::endl; 
+    benchmark::report(steps);
   }
 
   // Write output to file
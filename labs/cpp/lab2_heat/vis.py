@@ -1,28 +1,76 @@
+import os
 import numpy as np
 import matplotlib.pyplot as plt
 
 #plt.style.use('dark_background') # Uncomment for dark background
 
-def visualize(name = 'output'):
+def read_output(name = 'output'):
+    # Header of the 2D solvers: uint64 {nx, ny}; of the 3D solvers: uint64 {0, 3, nx, ny, nz}.
+    # Either is followed by the float64 time, and the values in row-major order.
     f = open(name, 'rb')
     grid = np.fromfile(f, dtype=np.uint64, count=2, offset=0)
-
-    nx = grid[0]
-    ny = grid[1]
+    if grid[0] == 0:
+        ndims = int(grid[1])
+        shape = tuple(int(e) for e in np.fromfile(f, dtype=np.uint64, count=ndims, offset=0))
+        # The values of u(z, y, x) are stored with x innermost:
+        shape = shape[::-1]
+    else:
+        shape = (int(grid[0]), int(grid[1]))
 
     times = np.fromfile(f, dtype=np.float64, count=1, offset=0)
     time = times[0]
 
     values = np.fromfile(f, dtype=np.float64, offset=0)
-    assert len(values) == nx * ny, f'{len(values)} != {nx * ny}'
-    values = values.reshape((nx, ny))
+    assert len(values) == np.prod(shape), f'{len(values)} != {np.prod(shape)}'
+    return values.reshape(shape), time
 
-    print(f'Plotting grid {nx}x{ny}, t = {time}')
+def visualize(name = 'output'):
+    values, time = read_output(name)
+    if values.ndim == 3:
+        # Plot the z-x plane through the middle of y, across the hot boundary at z = 0:
+        nz, ny, nx = values.shape
+        print(f'Plotting grid {nx}x{ny}x{nz} at y = {ny // 2}, t = {time}')
+        values = values[:, ny // 2, :]
+        xlabel, ylabel = 'x', 'z'
+    else:
+        nx, ny = values.shape
+        print(f'Plotting grid {nx}x{ny}, t = {time}')
+        xlabel, ylabel = 'x', 'y'
     print(values.shape)
 
     plt.title(f'Temperature at t = {time:.3f} [s]')
+    plt.xlabel(xlabel)
+    plt.ylabel(ylabel)
+    plt.pcolormesh(values, cmap=plt.cm.jet, vmin=0.0, vmax=values.max())
+    plt.colorbar()
+    plt.savefig('output.png', transparent=True, bbox_inches='tight', dpi=300)
+
+def read_series(name = 'snapshots'):
+    # Time-series layout: uint64 {nx, ny}, then per frame: uint64 step, float64 time, nx * ny float64 values
+    f = open(name, 'rb')
+    grid = np.fromfile(f, dtype=np.uint64, count=2, offset=0)
+
+    nx = int(grid[0])
+    ny = int(grid[1])
+
+    frame = np.dtype([('step', np.uint64), ('time', np.float64), ('values', np.float64, (nx, ny))])
+    # A run that is still writing can leave a partial frame at the end; ignore it.
+    count = (os.path.getsize(name) - grid.nbytes) // frame.itemsize
+    return np.fromfile(f, dtype=frame, count=count, offset=0)
+
+def visualize_series(name = 'snapshots', frame = -1):
+    frames = read_series(name)
+    assert len(frames) > 0, f'{name} contains no frames'
+    step = frames[frame]['step']
+    time = frames[frame]['time']
+    values = frames[frame]['values']
+    nx, ny = values.shape
+
+    print(f'Plotting frame {frame} of {len(frames)}: grid {nx}x{ny}, step = {step}, t = {time}')
+
+    plt.title(f'Temperature at t = {time:.3f} [s] (step {step})')
     plt.xlabel('x')
     plt.ylabel('y')
     plt.pcolormesh(values, cmap=plt.cm.jet, vmin=0.0, vmax=values.max())
     plt.colorbar()
-    plt.savefig('output.png', transparent=True, bbox_inches='tight', dpi=300)
\ No newline at end of file
+    plt.savefig(f'snapshot_{step}.png', transparent=True, bbox_inches='tight', dpi=300)
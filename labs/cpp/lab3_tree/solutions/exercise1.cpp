@@ -37,6 +37,8 @@
 #include <ranges>
 // DONE: add C++ standard library includes as necessary
 #include <atomic>
+#include <bench.hpp>
+#include <trace.hpp>
 
 /// Builds a trie in parallel by splitting the input into chunks
 void do_trie(std::vector<char> const &input, int domains);
@@ -115,16 +117,20 @@ void do_trie(std::vector<char> const &input, int domains) {
 
   // DONE: process all domains in parallel
   // NOTE: we cannot use "par_unseq" here because the algorithm is starvation free.
+  trace::range phase("make_trie");
   std::for_each_n(std::execution::par, std::views::iota(0).begin(), domains,
                   [t, b, domains, input = input.data(), size = input.size()](auto domain) {
                     make_trie(*t, *b, input, input + size, domain, domains);
                   });
 
-  auto const time =
-      std::chrono::duration_cast<std::chrono::milliseconds>(clk_t::now() - begin).count();
+  auto const seconds = benchmark::seconds_since(begin);
+  auto const time = static_cast<long>(seconds * 1e3);
   auto const count = b->load() - nodes.data();
   std::cout << "Assembled " << count << " nodes on " << domains << " domains in " << time << "ms."
             << std::endl;
+  benchmark::result r{"trie " + std::to_string(domains) + " domains", {double(input.size()), 0.}};
+  r.add(seconds);
+  benchmark::report(r);
 }
 
 // Given an array of characters [`begin`, `end`), splits the array into `domains`,
@@ -0,0 +1,1284 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+//! Variant of exercise1_gpu for corpora that do not fit the fixed node array of exercise1.
+//!
+//! The nodes are allocated from a growable concurrent arena: a reserved range of virtual memory,
+//! only backed by physical memory as nodes are constructed, which is handed out to threads in
+//! chunks. The arena reports the memory used, and allocations beyond its capacity are counted
+//! instead of overrunning the memory.
+//!
+//! The node layout is a template parameter: `pointer_node` is the layout of exercise1, and
+//! `compact_node` replaces its child pointers and flags by 32-bit arena offsets.
+//!
+//! The insertion protocol is a template parameter as well: with `insertion::flag`, the thread that
+//! claims a child allocates it while the others wait for it, as in exercise1; with
+//! `insertion::cas`, every thread that finds a child missing allocates one speculatively and
+//! publishes it with a compare-and-swap. The threads that lose the race return their node to their
+//! cache of the arena and continue with the winner's node, so threads never wait on each other.
+//!
+//! The books are memory mapped instead of read into a vector, and the trie is built from the
+//! mapped files in place: domains split the concatenation of the files, and a file boundary
+//! delimits words. GPUs that cannot access pageable host memory read the books through two pinned
+//! staging buffers instead, copying the next chunk of the corpus while the trie is built from the
+//! current one.
+//!
+//! `trie_stream` builds a trie incrementally from streams of unbounded length, such as logs: it
+//! reads a stream in chunks of fixed size, inserts every chunk in parallel while the next one is
+//! read, and carries a word that continues past the end of a chunk over to the next one. The trie
+//! can be queried whenever a stream has been appended.
+//!
+//! Queries (word counts, prefix enumeration, top-k words, and batched parallel lookups) are generic
+//! over a trie handle: `trie_view` queries the trie of an arena in place, and `frozen_trie` is a
+//! read-only copy of it in breadth-first order with the children of a node stored as a bit mask,
+//! which `freeze` produces once the trie is complete.
+//!
+//! The number of domains is also auto-tuned: `tune_domains` times the build of a prefix of the
+//! input for a few numbers of domains and caches the fastest in a profile file, `trie.profile` or
+//! the file that `TRIE_PROFILE` names, by device and power-of-two bucket of the input size, such
+//! that later runs skip the sweep.
+//!
+//! Every word starts at the root, so the top levels of the trie take most of the atomic traffic.
+//! `insert_corpus_privatized` gives every group of domains a private copy of the top levels,
+//! which counts the short words and caches the shared nodes below them, and merges the copies into
+//! the trie at the end, summing their counts with `std::transform_reduce`.
+//!
+//! Usage: ./tree [<capacity in nodes>]
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <ranges>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <bench.hpp>
+#include <trace.hpp>
+// NOTE: We include std::atomic except when -stdpar=gpu, in which case we include cuda::atomic
+#if defined(_NVHPC_STDPAR_GPU)
+#include <cuda/atomic>
+#include <cuda_runtime.h>
+template <typename T> using atomic = cuda::atomic<T, cuda::thread_scope_device>;
+constexpr auto memory_order_relaxed = cuda::memory_order_relaxed;
+constexpr auto memory_order_acquire = cuda::memory_order_acquire;
+constexpr auto memory_order_release = cuda::memory_order_release;
+constexpr auto memory_order_acq_rel = cuda::memory_order_acq_rel;
+#else // _NVHPC_STDPAR_GPU
+#include <atomic>
+template <typename T> using atomic = std::atomic<T>;
+constexpr auto memory_order_relaxed = std::memory_order_relaxed;
+constexpr auto memory_order_acquire = std::memory_order_acquire;
+constexpr auto memory_order_release = std::memory_order_release;
+constexpr auto memory_order_acq_rel = std::memory_order_acq_rel;
+#endif // _NVHPC_STDPAR_GPU
+
+/// Protocol to insert a missing child into the trie.
+enum class insertion { flag, cas };
+
+constexpr char const *name(insertion i) { return i == insertion::flag ? "flag" : "CAS"; }
+
+/// Text of the input files, mapped into memory.
+///
+/// `files` is the sequence of texts that the trie is built from, without copying them; their
+/// concatenation is split into domains, and words never continue from one file into the next.
+struct corpus {
+  std::vector<std::span<char const>> files;
+  std::size_t size = 0;
+
+  static corpus map(std::span<char const *const> paths);
+  static void unmap(corpus &c);
+};
+
+/// Builds a trie in parallel by splitting the input into chunks
+template <class Node, insertion I>
+void do_trie(corpus const &input, int domains, std::size_t capacity);
+
+/// Returns the number of domains that builds the trie of `input` fastest on this device
+template <class Node, insertion I>
+int tune_domains(corpus const &input, std::size_t capacity);
+
+/// Builds the trie with each number of domains of exercise1, and with the tuned one
+template <class Node, insertion I>
+void do_tries(corpus const &input, std::size_t capacity) {
+  std::cout << Node::name() << " nodes (" << sizeof(Node) << " B/node), " << name(I)
+            << " insertion:" << std::endl;
+  // Build trie using one domain (sequentially)
+  do_trie<Node, I>(input, 1, capacity);
+  do_trie<Node, I>(input, std::thread::hardware_concurrency(), capacity);
+  do_trie<Node, I>(input, 100000, capacity);
+  do_trie<Node, I>(input, tune_domains<Node, I>(input, capacity), capacity);
+}
+
+/// Streams the books one after the other into one trie, querying it after each book
+template <class Node, insertion I>
+void do_stream(std::span<char const *const> files, std::size_t capacity);
+
+/// Queries the trie of the books, before and after freezing it
+template <class Node, insertion I>
+void do_queries(corpus const &input, std::size_t capacity);
+
+/// Compares building the trie with shared and with privatized top levels
+template <class Node, insertion I>
+void do_privatized(corpus const &input, std::size_t capacity);
+
+struct pointer_node;
+struct compact_node;
+
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    std::cerr << "ERROR: incorrect arguments" << std::endl;
+    std::cerr << "  " << argv[0] << " [<capacity in nodes>]" << std::endl;
+    std::terminate();
+  }
+  // By default, the capacity of the arena is derived from the input size:
+  std::size_t capacity = argc == 2 ? std::stoull(argv[1]) : 0;
+
+  // Books:
+  char const *files[] = {"2600-0.txt", "2701-0.txt", "35-0.txt",  "84-0.txt",
+                         "8800.txt",   "1727-0.txt", "55-0.txt",  "6130-0.txt",
+                         "996-0.txt",  "1342-0.txt", "3825-0.txt"};
+
+  // Map all books into memory:
+  auto input = corpus::map(files);
+  std::cout << "Input size " << input.size << " chars." << std::endl;
+
+  do_tries<pointer_node, insertion::flag>(input, capacity);
+  do_tries<pointer_node, insertion::cas>(input, capacity);
+  do_tries<compact_node, insertion::flag>(input, capacity);
+  do_tries<compact_node, insertion::cas>(input, capacity);
+
+  do_queries<compact_node, insertion::cas>(input, capacity);
+
+  do_privatized<pointer_node, insertion::flag>(input, capacity);
+  do_privatized<compact_node, insertion::cas>(input, capacity);
+
+  corpus::unmap(input);
+
+  // Build the trie incrementally from streams of the books:
+  do_stream<compact_node, insertion::cas>(files, capacity);
+  return 0;
+}
+
+/// Concurrent arena of trie nodes.
+///
+/// Threads claim chunks of `chunk_size()` nodes with one atomic operation and then allocate nodes
+/// from their chunk without synchronization; a node is only constructed, and its memory only
+/// touched, when it is allocated. Node 0 is the root, and node 1 is a "sink" whose children are the
+/// sink itself: allocations beyond the capacity return the sink, such that insertion proceeds
+/// without overrunning the arena, and the failed allocations are counted.
+///
+/// The arena is a handle that is copied into the parallel algorithms; `destroy` releases it.
+template <class Node>
+struct node_arena {
+  // NOTE: device threads have no thread_local storage, so on the GPU every domain caches its own
+  // chunk, and chunks are small to bound the memory left unused at the end of each domain.
+#if defined(_NVHPC_STDPAR_GPU)
+  static constexpr std::size_t chunk_size() { return 16; }
+#else
+  static constexpr std::size_t chunk_size() { return 1024; }
+#endif
+
+  // Chunk cached by one thread, and a node that it allocated but did not insert into the trie;
+  // `epoch` identifies the arena that they belong to.
+  struct cursor {
+    Node *next = nullptr, *end = nullptr;
+    Node *spare = nullptr;
+    unsigned epoch = 0;
+  };
+
+  struct counters {
+    atomic<std::size_t> claimed{2}; // nodes handed out in chunks (root and sink are preallocated)
+    atomic<std::size_t> used{1};    // nodes of the trie, i.e., without the sink
+    atomic<std::size_t> overflowed{0};
+  };
+
+  Node *nodes;
+  std::size_t capacity;
+  counters *stats;
+  unsigned epoch;
+
+  static node_arena create(std::size_t capacity);
+  static void destroy(node_arena &a);
+
+  Node *root() const { return nodes; }
+  Node *sink() const { return nodes + 1; }
+  Node *at(std::size_t offset) const { return nodes + offset; }
+  std::size_t offset_of(Node const *n) const { return n - nodes; }
+
+  // Allocates a node: the spare node of `c` if any, or one from the chunk cached in `c`, claiming a
+  // new chunk if necessary.
+  Node *allocate(cursor &c) const {
+    if (c.epoch == epoch && c.spare != nullptr) return std::exchange(c.spare, nullptr);
+    if (c.epoch != epoch || c.next == c.end) {
+      auto const b = stats->claimed.fetch_add(chunk_size(), memory_order_relaxed);
+      if (b >= capacity) {
+        stats->overflowed.fetch_add(1, memory_order_relaxed);
+        c = {};
+        return sink();
+      }
+      c = {.next = nodes + b, .end = nodes + std::min(b + chunk_size(), capacity), .epoch = epoch};
+    }
+    return new (c.next++) Node{};
+  }
+
+  // Returns a node that `allocate` returned but that was not inserted into the trie to `c`; since
+  // no other thread has seen the node, it is reused as is by the next allocation.
+  void release(cursor &c, Node *n) const {
+    if (n != sink()) c.spare = n;
+  }
+
+  std::size_t nodes_used() const { return stats->used.load(); }
+  std::size_t bytes_used() const { return nodes_used() * sizeof(Node); }
+  std::size_t bytes_reserved() const { return capacity * sizeof(Node); }
+  std::size_t overflowed() const { return stats->overflowed.load(); }
+};
+
+template <class Node>
+node_arena<Node> node_arena<Node>::create(std::size_t capacity) {
+  static unsigned epochs = 0;
+  capacity = std::clamp<std::size_t>(capacity, 2, Node::max_nodes());
+  auto const bytes = capacity * sizeof(Node);
+  void *ptr = nullptr;
+#if defined(_NVHPC_STDPAR_GPU)
+  // Managed memory is only populated on first touch.
+  if (cudaMallocManaged(&ptr, bytes) != cudaSuccess) ptr = nullptr;
+#else
+  ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+             -1, 0);
+  if (ptr == MAP_FAILED) ptr = nullptr;
+#endif
+  if (ptr == nullptr) {
+    std::cerr << "ERROR: failed to reserve " << bytes << " B for " << capacity << " trie nodes"
+              << std::endl;
+    std::terminate();
+  }
+  node_arena a{.nodes = static_cast<Node *>(ptr),
+               .capacity = capacity,
+               .stats = new counters,
+               .epoch = ++epochs};
+  new (a.root()) Node{};
+  new (a.sink()) Node{};
+  a.sink()->make_sink(a);
+  return a;
+}
+
+template <class Node>
+void node_arena<Node>::destroy(node_arena &a) {
+#if defined(_NVHPC_STDPAR_GPU)
+  cudaFree(a.nodes);
+#else
+  munmap(a.nodes, a.bytes_reserved());
+#endif
+  delete a.stats;
+  a = {};
+}
+
+/// A node of the Trie with one pointer and one "allocating" flag per child.
+struct pointer_node {
+  // Pointers to children
+  struct child_ref {
+    atomic<pointer_node *> ptr;
+    atomic<int> flag;
+  };
+  std::array<child_ref, 26> children;
+  // Number of words ending at this node
+  atomic<int> count = 0;
+
+  static constexpr char const *name() { return "Pointer"; }
+  static constexpr std::size_t max_nodes() { return SIZE_MAX; }
+
+  // Returns the child at `index`, calling `allocate` to create it if it does not exist yet.
+  template <class F>
+  pointer_node *child(node_arena<pointer_node> const &, int index, F &&allocate) {
+    auto &c = children[index];
+    // If there is no child at the edge for the character we allocate it:
+    if (c.ptr.load(memory_order_acquire) == nullptr) {
+      // NOTE: only one of the threads that arrives should allocate memory and set the child
+      // node, all other threads should wait for that to complete
+      if (c.flag.exchange(1, memory_order_relaxed) == 0) {
+        // The first thread that arrives sees an old "false" value and allocates the memory:
+        c.ptr.store(allocate(), memory_order_release);
+      } else {
+        // All other threads see a "true" value and wait on the value
+        // of the pointer changing from "nullptr" to something else
+        while (nullptr == c.ptr.load(memory_order_acquire)) {
+        }
+      }
+    }
+    return c.ptr.load(memory_order_relaxed);
+  }
+
+  // Returns the child at `index`, publishing a node from `allocate` if it does not exist yet and
+  // handing it to `release` if another thread published the child first.
+  template <class F, class G>
+  pointer_node *speculative_child(node_arena<pointer_node> const &, int index, F &&allocate,
+                                  G &&release) {
+    auto &c = children[index];
+    auto *p = c.ptr.load(memory_order_acquire);
+    if (p != nullptr) return p;
+    auto *n = allocate();
+    if (c.ptr.compare_exchange_strong(p, n, memory_order_acq_rel, memory_order_acquire)) return n;
+    release(n);
+    return p;
+  }
+
+  // Returns the child at `index`, or nullptr if it does not exist.
+  pointer_node *find_child(node_arena<pointer_node> const &, int index) const {
+    return children[index].ptr.load(memory_order_acquire);
+  }
+
+  void make_sink(node_arena<pointer_node> const &a) {
+    for (auto &c : children) {
+      c.ptr.store(a.sink(), memory_order_relaxed);
+      c.flag.store(1, memory_order_relaxed);
+    }
+  }
+};
+
+/// A node of the Trie with 32-bit arena offsets as children, ~4x smaller than `pointer_node`.
+///
+/// Offset 0 is the root, which is never a child, and thus encodes "no child", and the reserved
+/// offset `allocating` encodes that a thread is allocating the child, replacing the flag.
+struct compact_node {
+  static constexpr std::uint32_t empty = 0;
+  static constexpr std::uint32_t allocating = UINT32_MAX;
+
+  std::array<atomic<std::uint32_t>, 26> children;
+  // Number of words ending at this node
+  atomic<int> count = 0;
+
+  static constexpr char const *name() { return "Compact"; }
+  static constexpr std::size_t max_nodes() { return allocating; }
+
+  // Returns the child at `index`, calling `allocate` to create it if it does not exist yet.
+  template <class F>
+  compact_node *child(node_arena<compact_node> const &a, int index, F &&allocate) {
+    auto &c = children[index];
+    auto o = c.load(memory_order_acquire);
+    if (o == empty) {
+      // Only the thread that swaps "empty" for "allocating" allocates the child:
+      std::uint32_t expected = empty;
+      if (c.compare_exchange_strong(expected, allocating, memory_order_relaxed)) {
+        o = static_cast<std::uint32_t>(a.offset_of(allocate()));
+        c.store(o, memory_order_release);
+        return a.at(o);
+      }
+      o = expected;
+    }
+    // All other threads wait for the offset to be published:
+    while (o == allocating) {
+      o = c.load(memory_order_acquire);
+    }
+    return a.at(o);
+  }
+
+  // Returns the child at `index`, publishing a node from `allocate` if it does not exist yet and
+  // handing it to `release` if another thread published the child first.
+  template <class F, class G>
+  compact_node *speculative_child(node_arena<compact_node> const &a, int index, F &&allocate,
+                                  G &&release) {
+    auto &c = children[index];
+    auto o = c.load(memory_order_acquire);
+    if (o != empty) return a.at(o);
+    auto *n = allocate();
+    if (c.compare_exchange_strong(o, static_cast<std::uint32_t>(a.offset_of(n)),
+                                  memory_order_acq_rel, memory_order_acquire))
+      return n;
+    release(n);
+    return a.at(o);
+  }
+
+  // Returns the child at `index`, or nullptr if it does not exist.
+  compact_node *find_child(node_arena<compact_node> const &a, int index) const {
+    auto const o = children[index].load(memory_order_acquire);
+    return o == empty || o == allocating ? nullptr : a.at(o);
+  }
+
+  void make_sink(node_arena<compact_node> const &a) {
+    auto const sink = static_cast<std::uint32_t>(a.offset_of(a.sink()));
+    for (auto &c : children)
+      c.store(sink, memory_order_relaxed);
+  }
+};
+
+int index_of(char c) {
+  // If character is a lower or upper case character, that's the index for the child node:
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  // All other characters are considered delimiters.
+  // (do not support unicode, etc.)
+  return -1;
+}
+
+corpus corpus::map(std::span<char const *const> paths) {
+  corpus c;
+  for (auto *path : paths) {
+    int const fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+      std::cerr << "ERROR: failed to open " << path << std::endl;
+      std::terminate();
+    }
+    std::size_t const bytes = st.st_size;
+    if (bytes > 0) {
+      void *ptr = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr == MAP_FAILED) {
+        std::cerr << "ERROR: failed to map " << path << std::endl;
+        std::terminate();
+      }
+      // The trie is built in one sequential pass over each domain: read ahead aggressively, and
+      // back the mapping with huge pages where the kernel supports it for files.
+      madvise(ptr, bytes, MADV_SEQUENTIAL);
+      madvise(ptr, bytes, MADV_HUGEPAGE);
+      c.files.emplace_back(static_cast<char const *>(ptr), bytes);
+      c.size += bytes;
+    }
+    close(fd);
+  }
+  return c;
+}
+
+void corpus::unmap(corpus &c) {
+  for (auto f : c.files)
+    munmap(const_cast<char *>(f.data()), f.size());
+  c = {};
+}
+
+#if defined(_NVHPC_STDPAR_GPU)
+// Returns whether the GPU can access the pages of the mapped files.
+bool device_accessible(corpus const &) {
+  int device = 0, pageable = 0;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&pageable, cudaDevAttrPageableMemoryAccess, device);
+  return pageable != 0;
+}
+
+// Copies the corpus in chunks into two pinned buffers and calls `build` with the texts of each
+// chunk while the next chunk is being copied. Chunks are cut after a delimiter, such that words
+// do not continue from one chunk into the next.
+template <class F>
+void stage(corpus const &c, F &&build) {
+  constexpr std::size_t chunk = std::size_t(64) << 20;
+  char *buffers[2];
+  for (auto &b : buffers) {
+    if (cudaMallocHost(&b, chunk) != cudaSuccess) {
+      std::cerr << "ERROR: failed to allocate " << chunk << " B of pinned memory" << std::endl;
+      std::terminate();
+    }
+  }
+
+  // Copies the next chunk of the corpus into `buffer`, returning its texts:
+  std::size_t file = 0, pos = 0;
+  auto copy = [&](char *buffer) {
+    std::vector<std::span<char const>> texts;
+    std::size_t used = 0;
+    while (file < c.files.size() && used < chunk) {
+      auto const rest = c.files[file].subspan(pos);
+      auto n = std::min(rest.size(), chunk - used);
+      if (n < rest.size()) {
+        auto m = n;
+        while (m > 0 && index_of(rest[m - 1]) != -1)
+          --m;
+        // Leave a word that does not fit for the next chunk, unless it fills a whole chunk:
+        if (m == 0 && used > 0) break;
+        if (m > 0) n = m;
+      }
+      std::memcpy(buffer + used, rest.data(), n);
+      texts.emplace_back(buffer + used, n);
+      used += n;
+      pos += n;
+      if (pos == c.files[file].size()) {
+        ++file;
+        pos = 0;
+      }
+    }
+    return texts;
+  };
+
+  auto next = std::async(std::launch::async, copy, buffers[0]);
+  for (int k = 1;; k ^= 1) {
+    auto const texts = next.get();
+    if (texts.empty()) break;
+    next = std::async(std::launch::async, copy, buffers[k]);
+    build(std::span{texts});
+  }
+
+  for (auto *b : buffers)
+    cudaFreeHost(b);
+}
+#endif // _NVHPC_STDPAR_GPU
+
+template <insertion I, class Node>
+void make_trie(node_arena<Node> arena, std::span<std::span<char const> const> text,
+               std::size_t size, unsigned domain, unsigned domains);
+
+// Calls `f(i)` for every i in [0, `n`) in parallel, with the execution policy that the insertion
+// protocol `I` allows.
+template <insertion I, class F>
+void parallel_for(int n, F f) {
+  auto run = [&](auto policy) { std::for_each_n(policy, std::views::iota(0).begin(), n, f); };
+  // NOTE: we cannot use "par_unseq" with the flag protocol because it is starvation free; the CAS
+  // protocol never waits, which allows "par_unseq" on the GPU (on the CPU, the thread_local chunk
+  // cache of make_trie requires "par").
+#if defined(_NVHPC_STDPAR_GPU)
+  if constexpr (I == insertion::cas)
+    run(std::execution::par_unseq);
+  else
+#endif
+    run(std::execution::par);
+}
+
+// Returns the number of characters of the concatenation of `text`.
+std::size_t size_of(std::span<std::span<char const> const> text) {
+  std::size_t size = 0;
+  for (auto t : text)
+    size += t.size();
+  return size;
+}
+
+// Inserts the words of the concatenation of `text` into the trie of the `arena` on `domains`.
+template <insertion I, class Node>
+void insert_words(node_arena<Node> arena, std::span<std::span<char const> const> text,
+                  int domains) {
+  parallel_for<I>(domains, [arena, domains, text, size = size_of(text)](auto domain) {
+    make_trie<I>(arena, text, size, domain, domains);
+  });
+}
+
+// Returns the capacity of an arena that fits the trie of `input` built on `domains`.
+template <class Node>
+std::size_t default_capacity(corpus const &input, int domains) {
+  // A word of n characters allocates at most n nodes, plus the chunks left partially unused:
+  auto const caches = (std::size_t)domains + std::thread::hardware_concurrency();
+  auto const memory = (std::size_t)sysconf(_SC_PHYS_PAGES) * (std::size_t)sysconf(_SC_PAGE_SIZE);
+  return std::min(input.size + 2 + caches * node_arena<Node>::chunk_size(), memory / sizeof(Node));
+}
+
+// Calls `build(text)` with texts whose concatenation is `input`, accessible on the device.
+template <class F>
+void for_each_text(corpus const &input, F &&build) {
+#if defined(_NVHPC_STDPAR_GPU)
+  if (!device_accessible(input))
+    stage(input, build);
+  else
+#endif
+    build(input.files);
+}
+
+// Inserts the words of `input` into the trie of the `arena` on `domains`.
+template <insertion I, class Node>
+void insert_corpus(node_arena<Node> arena, corpus const &input, int domains) {
+  for_each_text(input, [&](std::span<std::span<char const> const> text) {
+    insert_words<I>(arena, text, domains);
+  });
+}
+
+template <class Node, insertion I>
+void do_trie(corpus const &input, int domains, std::size_t capacity) {
+  if (capacity == 0) capacity = default_capacity<Node>(input, domains);
+  auto arena = node_arena<Node>::create(capacity);
+
+  using clk_t = std::chrono::steady_clock;
+  auto const begin = clk_t::now();
+
+  trace::range phase("insert_corpus");
+  insert_corpus<I>(arena, input, domains);
+
+  auto const seconds = benchmark::seconds_since(begin);
+  auto const time = static_cast<long>(seconds * 1e3);
+  std::cout << "Assembled " << arena.nodes_used() << " nodes on " << domains << " domains in "
+            << time << "ms. Arena: " << arena.bytes_used() * 1e-6 << " MB used of "
+            << arena.bytes_reserved() * 1e-6 << " MB reserved." << std::endl;
+  benchmark::result r{"trie " + std::to_string(domains) + " domains", {double(input.size), 0.}};
+  r.add(seconds);
+  benchmark::report(r);
+  if (arena.overflowed() > 0) {
+    std::cerr << "WARNING: arena overflow, " << arena.overflowed() << " node allocations failed;"
+              << " the trie is incomplete (capacity " << arena.capacity << " nodes)" << std::endl;
+  }
+  node_arena<Node>::destroy(arena);
+}
+
+// Returns the name of the device that builds the trie.
+std::string device_name() {
+#if defined(_NVHPC_STDPAR_GPU)
+  int device = 0;
+  cudaDeviceProp prop;
+  cudaGetDevice(&device);
+  cudaGetDeviceProperties(&prop, device);
+  return prop.name;
+#else
+  std::string model = "cpu";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for (std::string line; std::getline(cpuinfo, line);) {
+    if (line.starts_with("model name")) {
+      model = line.substr(line.find(':') + 2);
+      break;
+    }
+  }
+  return model + " x" + std::to_string(std::thread::hardware_concurrency());
+#endif
+}
+
+template <class Node, insertion I>
+int tune_domains(corpus const &input, std::size_t capacity) {
+  // Tuned numbers of domains are cached by device, trie, and power-of-two bucket of the input size,
+  // one tab-separated entry per line:
+  char const *env = std::getenv("TRIE_PROFILE");
+  std::string const path = env ? env : "trie.profile";
+  std::string const key = device_name() + "\t" + Node::name() + "\t" + name(I) + "\t" +
+                          std::to_string(std::bit_width(input.size));
+  {
+    std::ifstream profile(path);
+    for (std::string line; std::getline(profile, line);) {
+      auto const tab = line.rfind('\t');
+      if (tab != std::string::npos && line.substr(0, tab) == key) {
+        auto const domains = std::stoi(line.substr(tab + 1));
+        std::cout << "Tuned " << domains << " domains (from " << path << ")." << std::endl;
+        return domains;
+      }
+    }
+  }
+
+  // Build the trie of a prefix of the input, one eighth of it, with a growing number of domains:
+  corpus prefix;
+  for (auto f : input.files) {
+    if (prefix.size >= input.size / 8) break;
+    prefix.files.push_back(f.first(std::min(f.size(), input.size / 8 - prefix.size)));
+    prefix.size += prefix.files.back().size();
+  }
+  using clk_t = std::chrono::steady_clock;
+  auto const begin = clk_t::now();
+  int const threads = std::thread::hardware_concurrency();
+  // Domains of fewer than 64 characters contend on the top levels of the trie only:
+  int const max_domains = std::clamp<std::size_t>(prefix.size / 64, 1, 1 << 20);
+  std::ostringstream sweep;
+  int best = 1;
+  double best_time = std::numeric_limits<double>::max();
+  for (int domains = 1; domains <= max_domains;
+       domains = domains < threads ? threads : domains * 4) {
+    auto arena = node_arena<Node>::create(capacity ? capacity
+                                                   : default_capacity<Node>(prefix, domains));
+    auto const t0 = clk_t::now();
+    insert_corpus<I>(arena, prefix, domains);
+    auto const time = std::chrono::duration<double, std::milli>(clk_t::now() - t0).count();
+    node_arena<Node>::destroy(arena);
+    sweep << " " << domains << ":" << time << "ms";
+    if (time < best_time) {
+      best = domains;
+      best_time = time;
+    }
+  }
+  auto const time =
+      std::chrono::duration_cast<std::chrono::milliseconds>(clk_t::now() - begin).count();
+  std::cout << "Tuned " << best << " domains on " << prefix.size << " chars in " << time
+            << "ms (" << path << "):" << sweep.str() << std::endl;
+
+  std::ofstream profile(path, std::ios::app);
+  profile << key << "\t" << best << "\n";
+  if (!profile) std::cerr << "WARNING: failed to write the profile " << path << std::endl;
+  return best;
+}
+
+// Given the concatenation of the texts `text` of `size` characters, splits it into `domains`, and
+// calls `f(word, length)` for the words that start in one `domain`.
+template <class F>
+void for_each_domain_word(std::span<std::span<char const> const> text, std::size_t size,
+                          unsigned domain, unsigned domains, F &&f) {
+  auto const domain_size = (size / domains + 1);
+
+  // Find the boundaries of the domain:
+  auto const domain_begin = std::min(size, domain_size * domain);
+  auto const domain_end = std::min(size, domain_begin + domain_size);
+
+  std::size_t offset = 0;
+  for (auto const t : text) {
+    if (offset >= domain_end) break;
+    // Find the boundaries of the domain within the text:
+    auto const begin = t.data();
+    auto const tsize = t.size();
+    auto b = std::clamp(domain_begin, offset, offset + tsize) - offset;
+    auto const e = std::clamp(domain_end, offset, offset + tsize) - offset;
+    offset += tsize;
+
+    // Handle domains that start in the middle of a word by incrementing the domain begin such
+    // that domains start at the beginning of a word:
+    for (; b < e && b > 0 && index_of(begin[b - 1]) != -1; ++b)
+      ;
+
+    // Visit the words that start in the domain; the end of a text ends a word:
+    while (b < tsize) {
+      // Skip delimiters; if the next word starts after the domain, then we are done
+      for (; b < tsize && index_of(begin[b]) == -1; ++b)
+        ;
+      if (b >= tsize || b >= e) break;
+      auto const w = b;
+      for (; b < tsize && index_of(begin[b]) != -1; ++b)
+        ;
+      f(begin + w, b - w);
+    }
+  }
+}
+
+/// Inserts nodes into the trie of an arena with the insertion protocol `I`, allocating from the
+/// chunk cached in `cache` and counting the nodes that it inserts.
+template <insertion I, class Node>
+struct inserter {
+  node_arena<Node> arena;
+  typename node_arena<Node>::cursor &cache;
+  std::size_t allocated = 0;
+
+  // Returns the child of `n` at `index`, inserting it if it does not exist yet.
+  Node *child(Node *n, int index) {
+    auto allocate = [&] {
+      auto next = arena.allocate(cache);
+      if (next != arena.sink()) ++allocated;
+      return next;
+    };
+    auto release = [&](Node *r) {
+      if (r != arena.sink()) --allocated;
+      arena.release(cache, r);
+    };
+    if constexpr (I == insertion::flag)
+      return n->child(arena, index, allocate);
+    else
+      return n->speculative_child(arena, index, allocate, release);
+  }
+
+  // One atomic operation to account for the nodes inserted so far:
+  void commit() {
+    arena.stats->used.fetch_add(allocated, memory_order_relaxed);
+    allocated = 0;
+  }
+};
+
+// Given the concatenation of the texts `text` of `size` characters, splits it into `domains`, and
+// inserts the words that start in one `domain` into the trie of the `arena`.
+template <insertion I, class Node>
+void make_trie(node_arena<Node> arena, std::span<std::span<char const> const> text,
+               std::size_t size, unsigned domain, unsigned domains) {
+#if defined(_NVHPC_STDPAR_GPU)
+  typename node_arena<Node>::cursor cache;
+#else
+  thread_local typename node_arena<Node>::cursor cache;
+#endif
+  inserter<I, Node> ins{arena, cache};
+
+  // Insert words of the domain into the trie: always start inserting a word at the root of the
+  // trie, and traverse to the next node for each character, allocating it if necessary:
+  for_each_domain_word(text, size, domain, domains, [&](char const *word, std::size_t length) {
+    Node *n = arena.root();
+    for (std::size_t i = 0; i < length; ++i)
+      n = ins.child(n, index_of(word[i]));
+    // At the end of the word, increment the word count for the current node:
+    assert(n);
+    n->count.fetch_add(1, memory_order_relaxed);
+  });
+
+  // One atomic operation per domain to account for the nodes it allocated:
+  ins.commit();
+}
+
+/// Read-only handle to the trie of an arena, for queries once it has been built.
+///
+/// A trie handle provides the root node, the child of a node for the index of a character, or
+/// nullptr if it does not exist, and the number of words that end at a node.
+template <class Node>
+struct trie_view {
+  using node_type = Node const *;
+  node_arena<Node> arena;
+
+  node_type root() const { return arena.root(); }
+  node_type child(node_type n, int index) const {
+    // The sink of an overflowed arena is the child of itself: exclude it from queries.
+    auto const c = n->find_child(arena, index);
+    return c == arena.sink() ? nullptr : c;
+  }
+  int count(node_type n) const { return n->count.load(memory_order_relaxed); }
+};
+
+/// A node of a frozen trie: its children are contiguous, in the order of their characters.
+struct frozen_node {
+  std::uint32_t children; // bit i is set if the node has a child for the character of index i
+  std::uint32_t first;    // index of the first child
+  int count;
+};
+
+/// Read-only trie in one contiguous array of nodes in breadth-first order.
+///
+/// The child for the character of index i is at `first` plus the number of children for
+/// characters of index less than i, which makes nodes ~9x smaller than `compact_node` (12 B vs.
+/// 108 B), and keeps the nodes of the top levels, which every lookup visits, in a few cache lines.
+struct frozen_trie {
+  using node_type = frozen_node const *;
+  frozen_node *nodes;
+  std::size_t size;
+
+  template <class Trie>
+  static frozen_trie freeze(Trie const &t);
+  static void destroy(frozen_trie &t) {
+    delete[] t.nodes;
+    t = {};
+  }
+
+  node_type root() const { return nodes; }
+  node_type child(node_type n, int index) const {
+    auto const bit = std::uint32_t(1) << index;
+    if ((n->children & bit) == 0) return nullptr;
+    return nodes + n->first + std::popcount(n->children & (bit - 1));
+  }
+  int count(node_type n) const { return n->count; }
+};
+
+template <class Trie>
+frozen_trie frozen_trie::freeze(Trie const &t) {
+  // Visit the nodes in breadth-first order: the children of the node at position i of `order` are
+  // appended to `order` when it is visited.
+  std::vector<typename Trie::node_type> order{t.root()};
+  std::vector<frozen_node> frozen;
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    auto const n = order[i];
+    frozen_node f{.children = 0, .first = static_cast<std::uint32_t>(order.size()),
+                  .count = t.count(n)};
+    for (int index = 0; index < 26; ++index) {
+      if (auto const c = t.child(n, index)) {
+        f.children |= std::uint32_t(1) << index;
+        order.push_back(c);
+      }
+    }
+    frozen.push_back(f);
+  }
+  frozen_trie r{.nodes = new frozen_node[frozen.size()], .size = frozen.size()};
+  std::copy(frozen.begin(), frozen.end(), r.nodes);
+  return r;
+}
+
+// Returns the number of times that `word` was inserted into the trie `t`.
+template <class Trie>
+int lookup(Trie const &t, std::string_view word) {
+  auto n = t.root();
+  for (char c : word) {
+    auto const index = index_of(c);
+    if (index == -1) return 0;
+    n = t.child(n, index);
+    if (n == nullptr) return 0;
+  }
+  return n == t.root() ? 0 : t.count(n);
+}
+
+// Looks up all `words` in parallel, writing the number of times that each was inserted into the
+// trie `t` to `counts`.
+template <class Trie>
+void lookup(Trie const &t, std::span<std::string_view const> words, std::span<int> counts) {
+  std::transform(std::execution::par_unseq, words.begin(), words.end(), counts.begin(),
+                 [t](std::string_view word) { return lookup(t, word); });
+}
+
+// Calls `f(word, count)` for every word of the trie `t` below the node `n` of the word `word`, in
+// lexicographic order.
+template <class Trie, class F>
+void for_each_word(Trie const &t, typename Trie::node_type n, std::string &word, F &&f) {
+  if (auto const c = t.count(n); c > 0) f(std::string_view{word}, c);
+  for (int index = 0; index < 26; ++index) {
+    if (auto const child = t.child(n, index)) {
+      word.push_back('a' + index);
+      for_each_word(t, child, word, f);
+      word.pop_back();
+    }
+  }
+}
+
+// Calls `f(word, count)` for every word of the trie `t` that starts with `prefix`, in
+// lexicographic order; words are lower case.
+template <class Trie, class F>
+void for_each_word(Trie const &t, std::string_view prefix, F &&f) {
+  std::string word;
+  auto n = t.root();
+  for (char c : prefix) {
+    auto const index = index_of(c);
+    if (index == -1) return;
+    n = t.child(n, index);
+    if (n == nullptr) return;
+    word.push_back('a' + index);
+  }
+  for_each_word(t, n, word, f);
+}
+
+// Returns the `k` most frequent words of the trie `t` and their counts, most frequent first.
+template <class Trie>
+std::vector<std::pair<int, std::string>> top_k(Trie const &t, std::size_t k) {
+  // Min-heap of the k most frequent words visited so far:
+  std::vector<std::pair<int, std::string>> top;
+  auto const cmp = std::greater<>{};
+  for_each_word(t, "", [&](std::string_view word, int count) {
+    if (top.size() == k && count <= top.front().first) return;
+    top.emplace_back(count, word);
+    std::push_heap(top.begin(), top.end(), cmp);
+    if (top.size() > k) {
+      std::pop_heap(top.begin(), top.end(), cmp);
+      top.pop_back();
+    }
+  });
+  std::sort_heap(top.begin(), top.end(), cmp);
+  return top;
+}
+
+/// Builds a trie incrementally from streams of characters that are read in chunks of `chunk`
+/// characters and inserted on `domains`.
+///
+/// Every chunk is cut after its last delimiter, and the rest, the beginning of a word, is carried
+/// over to the front of the next chunk; the end of a stream ends a word. The trie is complete, and
+/// can be queried, whenever `append` returns.
+template <class Node, insertion I>
+struct trie_stream {
+  node_arena<Node> arena;
+  std::size_t chunk;
+  int domains;
+  char *buffers[2];
+  std::vector<std::span<char const>> text{1};
+
+  trie_stream(std::size_t capacity, std::size_t chunk, int domains);
+  trie_stream(trie_stream const &) = delete;
+  trie_stream &operator=(trie_stream const &) = delete;
+  ~trie_stream();
+
+  // Reads `in` until its end and inserts its words into the trie:
+  void append(std::istream &in);
+
+  // Returns the number of times that `word` was inserted into the trie:
+  int count(std::string_view word) const;
+};
+
+template <class Node, insertion I>
+trie_stream<Node, I>::trie_stream(std::size_t capacity, std::size_t chunk, int domains)
+    : chunk(chunk), domains(domains) {
+  // The length of a stream is not known upfront: reserve the physical memory by default.
+  if (capacity == 0)
+    capacity = (std::size_t)sysconf(_SC_PHYS_PAGES) * (std::size_t)sysconf(_SC_PAGE_SIZE) /
+               sizeof(Node);
+  arena = node_arena<Node>::create(capacity);
+  for (auto &b : buffers) {
+#if defined(_NVHPC_STDPAR_GPU)
+    if (cudaMallocHost(&b, chunk) != cudaSuccess) b = nullptr;
+#else
+    b = new (std::nothrow) char[chunk];
+#endif
+    if (b == nullptr) {
+      std::cerr << "ERROR: failed to allocate a chunk of " << chunk << " B" << std::endl;
+      std::terminate();
+    }
+  }
+}
+
+template <class Node, insertion I>
+trie_stream<Node, I>::~trie_stream() {
+  for (auto *b : buffers) {
+#if defined(_NVHPC_STDPAR_GPU)
+    cudaFreeHost(b);
+#else
+    delete[] b;
+#endif
+  }
+  node_arena<Node>::destroy(arena);
+}
+
+template <class Node, insertion I>
+void trie_stream<Node, I>::append(std::istream &in) {
+  // Reads characters into `buffer` after the `carry` characters at its front:
+  auto read = [&in, chunk = chunk](char *buffer, std::size_t carry) {
+    in.read(buffer + carry, chunk - carry);
+    return carry + in.gcount();
+  };
+
+  int k = 0;
+  auto size = read(buffers[k], 0);
+  while (size > 0) {
+    // Cut the chunk after its last delimiter, unless it is the last chunk of the stream or a single
+    // word of the chunk spans it completely:
+    auto cut = size;
+    if (in) {
+      while (cut > 0 && index_of(buffers[k][cut - 1]) != -1)
+        --cut;
+      if (cut == 0) cut = size;
+    }
+    // Carry the beginning of the last word over to the next chunk and read the next chunk while
+    // the current one is inserted:
+    std::memcpy(buffers[k ^ 1], buffers[k] + cut, size - cut);
+    auto next = std::async(std::launch::async, read, buffers[k ^ 1], size - cut);
+    text[0] = {buffers[k], cut};
+    insert_words<I>(arena, text, domains);
+    size = next.get();
+    k ^= 1;
+  }
+
+  if (arena.overflowed() > 0) {
+    std::cerr << "WARNING: arena overflow, " << arena.overflowed() << " node allocations failed;"
+              << " the trie is incomplete (capacity " << arena.capacity << " nodes)" << std::endl;
+  }
+}
+
+template <class Node, insertion I>
+int trie_stream<Node, I>::count(std::string_view word) const {
+  return lookup(trie_view<Node>{arena}, word);
+}
+
+template <class Node, insertion I>
+void do_stream(std::span<char const *const> files, std::size_t capacity) {
+  constexpr std::size_t chunk = std::size_t(1) << 20;
+  std::cout << Node::name() << " nodes, " << name(I) << " insertion, streamed in chunks of "
+            << chunk << " chars:" << std::endl;
+  trie_stream<Node, I> trie(capacity, chunk, std::thread::hardware_concurrency());
+
+  using clk_t = std::chrono::steady_clock;
+  auto const begin = clk_t::now();
+  for (auto *path : files) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::cerr << "ERROR: failed to open " << path << std::endl;
+      std::terminate();
+    }
+    trie.append(in);
+    std::cout << "Appended " << path << ": " << trie.arena.nodes_used() << " nodes, \"the\" "
+              << trie.count("the") << " times." << std::endl;
+  }
+  auto const time =
+      std::chrono::duration_cast<std::chrono::milliseconds>(clk_t::now() - begin).count();
+  std::cout << "Streamed " << files.size() << " books in " << time << "ms." << std::endl;
+}
+
+template <class Node, insertion I>
+void do_queries(corpus const &input, std::size_t capacity) {
+  int const domains = std::thread::hardware_concurrency();
+  if (capacity == 0) capacity = default_capacity<Node>(input, domains);
+  auto arena = node_arena<Node>::create(capacity);
+  insert_corpus<I>(arena, input, domains);
+  trie_view<Node> const trie{arena};
+  std::cout << Node::name() << " nodes, " << name(I) << " insertion, queries:" << std::endl;
+
+  std::cout << "Top 10 words:";
+  for (auto const &[count, word] : top_k(trie, 10))
+    std::cout << " " << word << " (" << count << ")";
+  std::cout << std::endl;
+
+  std::size_t prefixed = 0;
+  for_each_word(trie, "th", [&](std::string_view, int) { ++prefixed; });
+  std::cout << "Distinct words starting with \"th\": " << prefixed << std::endl;
+
+  using clk_t = std::chrono::steady_clock;
+  auto const ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+  auto t0 = clk_t::now();
+  auto frozen = frozen_trie::freeze(trie);
+  std::cout << "Froze " << frozen.size << " nodes into " << frozen.size * sizeof(frozen_node) * 1e-6
+            << " MB in " << ms(clk_t::now() - t0) << "ms." << std::endl;
+
+  // Look up every word of the input, copied such that the words are accessible on the GPU
+  // (reserving the whole input keeps the views valid as the text grows):
+  std::vector<char> text;
+  std::vector<std::string_view> words;
+  text.reserve(input.size);
+  for (auto f : input.files) {
+    for (auto b = f.begin(); b != f.end();) {
+      auto const e = std::find_if(b, f.end(), [](char c) { return index_of(c) == -1; });
+      if (e != b) {
+        words.emplace_back(text.data() + text.size(), e - b);
+        text.insert(text.end(), b, e);
+      }
+      b = e == f.end() ? e : e + 1;
+    }
+  }
+  std::vector<int> counts(words.size()), frozen_counts(words.size());
+  t0 = clk_t::now();
+  lookup(trie, words, counts);
+  auto const t1 = clk_t::now();
+  lookup(frozen, words, frozen_counts);
+  auto const t2 = clk_t::now();
+  std::cout << "Looked up " << words.size() << " words in " << ms(t1 - t0) << "ms, frozen in "
+            << ms(t2 - t1) << "ms." << std::endl;
+  if (counts != frozen_counts) {
+    std::cerr << "ERROR: lookups in the frozen trie differ" << std::endl;
+    std::terminate();
+  }
+
+  frozen_trie::destroy(frozen);
+  node_arena<Node>::destroy(arena);
+}
+
+/// A node of the private copy of the top levels of the trie of a group of domains: the number of
+/// words of the group that end at the node, and the node of the shared trie, once a longer word
+/// of the group needed it.
+///
+/// A word w of up to L characters has the node of code c(w) = 26 c(w') + index + 1 of the copy,
+/// where w' is w without its last character, of `index`, and c("") = 0.
+template <class Node>
+struct private_node {
+  int count = 0;
+  Node *shared = nullptr;
+};
+
+// Returns the number of nodes of the private copy of `levels` top levels of the trie.
+constexpr std::size_t private_nodes(int levels) {
+  std::size_t nodes = 1, level = 1;
+  for (int l = 0; l < levels; ++l)
+    nodes += level *= 26;
+  return nodes;
+}
+
+// Returns the node of the shared trie for the word of `code`, of up to L characters, inserting the
+// nodes of the word if necessary.
+template <int L, insertion I, class Node>
+Node *resolve(inserter<I, Node> &ins, std::size_t code) {
+  std::array<int, L> indices;
+  int length = 0;
+  for (; code > 0; code = (code - 1) / 26)
+    indices[length++] = (code - 1) % 26;
+  Node *n = ins.arena.root();
+  while (length > 0)
+    n = ins.child(n, indices[--length]);
+  return n;
+}
+
+// Inserts the words that start in one `domain` of the concatenation of `text` into the trie of
+// the `arena`, counting the words of up to L characters in the private copy `top` instead.
+template <int L, insertion I, class Node>
+void make_trie_privatized(inserter<I, Node> &ins, private_node<Node> *top,
+                          std::span<std::span<char const> const> text, std::size_t size,
+                          unsigned domain, unsigned domains) {
+  for_each_domain_word(text, size, domain, domains, [&](char const *word, std::size_t length) {
+    std::size_t code = 0;
+    for (std::size_t i = 0; i < std::min<std::size_t>(length, L); ++i)
+      code = code * 26 + index_of(word[i]) + 1;
+    auto &p = top[code];
+    if (length <= L) {
+      ++p.count;
+      return;
+    }
+    // Longer words continue in the shared trie from the node of their first L characters:
+    if (p.shared == nullptr) p.shared = resolve<L>(ins, code);
+    Node *n = p.shared;
+    for (std::size_t i = L; i < length; ++i)
+      n = ins.child(n, index_of(word[i]));
+    n->count.fetch_add(1, memory_order_relaxed);
+  });
+}
+
+// Inserts the words of `input` into the trie of the `arena` on `domains`, which are split into
+// groups with private copies of the top L levels of the trie; returns the number of groups.
+template <int L, insertion I, class Node>
+int insert_corpus_privatized(node_arena<Node> arena, corpus const &input, int domains) {
+  // The domains of a group run one after the other, and every group adds a copy to merge:
+  constexpr std::size_t nodes = private_nodes(L);
+#if defined(_NVHPC_STDPAR_GPU)
+  // On the GPU, every group needs a thread: use as many groups as copies fit into 64 MB.
+  constexpr std::size_t max_groups = (64 << 20) / (nodes * sizeof(private_node<Node>));
+#else
+  // On the CPU, a few groups per thread balance the load.
+  std::size_t const max_groups = 4 * std::thread::hardware_concurrency();
+#endif
+  int const groups = std::min<std::size_t>(domains, std::max<std::size_t>(1, max_groups));
+  std::vector<private_node<Node>> copies(groups * nodes);
+
+  for_each_text(input, [&, top = copies.data()](std::span<std::span<char const> const> text) {
+    parallel_for<I>(groups, [=, size = size_of(text)](int group) {
+      typename node_arena<Node>::cursor cache;
+      inserter<I, Node> ins{arena, cache};
+      auto const first = (std::int64_t)domains * group / groups;
+      auto const last = (std::int64_t)domains * (group + 1) / groups;
+      for (auto domain = first; domain < last; ++domain)
+        make_trie_privatized<L>(ins, top + group * nodes, text, size, domain, domains);
+      ins.commit();
+    });
+  });
+
+  // Sum the counts of each node over the copies in parallel, and add them to the shared trie:
+  std::vector<int> counts(nodes);
+  std::for_each_n(std::execution::par_unseq, std::views::iota(std::size_t(0)).begin(), nodes,
+                  [groups, top = copies.data(), counts = counts.data()](std::size_t code) {
+                    auto const copies = std::views::iota(0, groups);
+                    counts[code] = std::transform_reduce(
+                        copies.begin(), copies.end(), 0, std::plus{},
+                        [=](int group) { return top[group * nodes + code].count; });
+                  });
+  typename node_arena<Node>::cursor cache;
+  inserter<I, Node> ins{arena, cache};
+  for (std::size_t code = 1; code < nodes; ++code) {
+    if (counts[code] > 0)
+      resolve<L>(ins, code)->count.fetch_add(counts[code], memory_order_relaxed);
+  }
+  ins.commit();
+  return groups;
+}
+
+template <class Node, insertion I>
+void do_privatized(corpus const &input, std::size_t capacity) {
+  constexpr int levels = 2;
+  std::cout << Node::name() << " nodes, " << name(I) << " insertion, top " << levels
+            << " levels privatized:" << std::endl;
+  using clk_t = std::chrono::steady_clock;
+  for (int domains : {1, (int)std::thread::hardware_concurrency(), 100000}) {
+    auto const n = capacity ? capacity : default_capacity<Node>(input, domains);
+
+    auto shared = node_arena<Node>::create(n);
+    auto const t0 = clk_t::now();
+    insert_corpus<I>(shared, input, domains);
+    auto const t1 = clk_t::now();
+    auto privatized = node_arena<Node>::create(n);
+    auto const groups = insert_corpus_privatized<levels, I>(privatized, input, domains);
+    auto const t2 = clk_t::now();
+
+    auto const ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << "On " << domains << " domains (" << groups << " groups): " << ms(t1 - t0)
+              << "ms shared, " << ms(t2 - t1) << "ms privatized, speedup "
+              << ms(t1 - t0) / ms(t2 - t1) << "x." << std::endl;
+    if (shared.nodes_used() != privatized.nodes_used()) {
+      std::cerr << "ERROR: the privatized trie has " << privatized.nodes_used()
+                << " nodes instead of " << shared.nodes_used() << std::endl;
+      std::terminate();
+    }
+    node_arena<Node>::destroy(privatized);
+    node_arena<Node>::destroy(shared);
+  }
+}
@@ -34,6 +34,7 @@
 #include <utility>
 #include <vector>
 #include <ranges>
+#include <bench.hpp>
 
 /// Builds a trie in parallel by splitting the input into chunks
 void do_trie(std::vector<char> const &input, int domains);
@@ -105,11 +106,14 @@ void do_trie(std::vector<char> const &input, int domains) {
                     make_trie(*t, *b, input, input + size, domain, domains);
                   });
 
-  auto const time =
-      std::chrono::duration_cast<std::chrono::milliseconds>(clk_t::now() - begin).count();
+  auto const seconds = benchmark::seconds_since(begin);
+  auto const time = static_cast<long>(seconds * 1e3);
   auto const count = *b - nodes.data();
   std::cout << "Assembled " << count << " nodes on " << domains << " domains in " << time << "ms."
             << std::endl;
+  benchmark::result r{"trie " + std::to_string(domains) + " domains", {double(input.size()), 0.}};
+  r.add(seconds);
+  benchmark::report(r);
 }
 
 // Given an array of characters [`begin`, `end`), splits the array into `domains`,